@@ -6,8 +6,8 @@
 using namespace Rcpp;
 
 // fastsk_compute_kernel
-void fastsk_compute_kernel(std::string train_file, std::string test_file, int g, int m, std::string kernel_file, int t, bool approx, double delta, int max_iters, bool skip_variance, std::string dictionary_file);
-RcppExport SEXP _FastGKMSVM_fastsk_compute_kernel(SEXP train_fileSEXP, SEXP test_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP kernel_fileSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP dictionary_fileSEXP) {
+void fastsk_compute_kernel(std::string train_file, std::string test_file, int g, int m, std::string kernel_file, int t, bool approx, double delta, int max_iters, bool skip_variance, std::string dictionary_file, bool binary);
+RcppExport SEXP _FastGKMSVM_fastsk_compute_kernel(SEXP train_fileSEXP, SEXP test_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP kernel_fileSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP dictionary_fileSEXP, SEXP binarySEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type train_file(train_fileSEXP);
@@ -21,7 +21,8 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< int >::type max_iters(max_itersSEXP);
     Rcpp::traits::input_parameter< bool >::type skip_variance(skip_varianceSEXP);
     Rcpp::traits::input_parameter< std::string >::type dictionary_file(dictionary_fileSEXP);
-    fastsk_compute_kernel(train_file, test_file, g, m, kernel_file, t, approx, delta, max_iters, skip_variance, dictionary_file);
+    Rcpp::traits::input_parameter< bool >::type binary(binarySEXP);
+    fastsk_compute_kernel(train_file, test_file, g, m, kernel_file, t, approx, delta, max_iters, skip_variance, dictionary_file, binary);
     return R_NilValue;
 END_RCPP
 }
@@ -50,10 +51,156 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// fastsk_train_and_score_kernel
+void fastsk_train_and_score_kernel(std::string kernel_file, int t, double C, double nu, double eps, std::string kernel_type, std::string metric, std::string metric_file);
+RcppExport SEXP _FastGKMSVM_fastsk_train_and_score_kernel(SEXP kernel_fileSEXP, SEXP tSEXP, SEXP CSEXP, SEXP nuSEXP, SEXP epsSEXP, SEXP kernel_typeSEXP, SEXP metricSEXP, SEXP metric_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type kernel_file(kernel_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< double >::type C(CSEXP);
+    Rcpp::traits::input_parameter< double >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel_type(kernel_typeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type metric(metricSEXP);
+    Rcpp::traits::input_parameter< std::string >::type metric_file(metric_fileSEXP);
+    fastsk_train_and_score_kernel(kernel_file, t, C, nu, eps, kernel_type, metric, metric_file);
+    return R_NilValue;
+END_RCPP
+}
+// fastsk_sweep_C
+DataFrame fastsk_sweep_C(std::string train_file, std::string test_file, int g, int m, NumericVector C_values, int t, bool approx, double delta, int max_iters, bool skip_variance, double nu, double eps, std::string kernel_type, std::string dictionary_file);
+RcppExport SEXP _FastGKMSVM_fastsk_sweep_C(SEXP train_fileSEXP, SEXP test_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP C_valuesSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP nuSEXP, SEXP epsSEXP, SEXP kernel_typeSEXP, SEXP dictionary_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type train_file(train_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type test_file(test_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type g(gSEXP);
+    Rcpp::traits::input_parameter< int >::type m(mSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type C_values(C_valuesSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< bool >::type approx(approxSEXP);
+    Rcpp::traits::input_parameter< double >::type delta(deltaSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iters(max_itersSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_variance(skip_varianceSEXP);
+    Rcpp::traits::input_parameter< double >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel_type(kernel_typeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dictionary_file(dictionary_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(fastsk_sweep_C(train_file, test_file, g, m, C_values, t, approx, delta, max_iters, skip_variance, nu, eps, kernel_type, dictionary_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// fastsk_train_and_score_tasks
+DataFrame fastsk_train_and_score_tasks(std::string train_file, std::string test_file, int g, int m, IntegerMatrix train_labels, Nullable<IntegerMatrix> test_labels, int t, bool approx, double delta, int max_iters, bool skip_variance, double C, double nu, double eps, std::string kernel_type, std::string dictionary_file, std::string metric_prefix);
+RcppExport SEXP _FastGKMSVM_fastsk_train_and_score_tasks(SEXP train_fileSEXP, SEXP test_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP train_labelsSEXP, SEXP test_labelsSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP CSEXP, SEXP nuSEXP, SEXP epsSEXP, SEXP kernel_typeSEXP, SEXP dictionary_fileSEXP, SEXP metric_prefixSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type train_file(train_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type test_file(test_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type g(gSEXP);
+    Rcpp::traits::input_parameter< int >::type m(mSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type train_labels(train_labelsSEXP);
+    Rcpp::traits::input_parameter< Nullable<IntegerMatrix> >::type test_labels(test_labelsSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< bool >::type approx(approxSEXP);
+    Rcpp::traits::input_parameter< double >::type delta(deltaSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iters(max_itersSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_variance(skip_varianceSEXP);
+    Rcpp::traits::input_parameter< double >::type C(CSEXP);
+    Rcpp::traits::input_parameter< double >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel_type(kernel_typeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dictionary_file(dictionary_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type metric_prefix(metric_prefixSEXP);
+    rcpp_result_gen = Rcpp::wrap(fastsk_train_and_score_tasks(train_file, test_file, g, m, train_labels, test_labels, t, approx, delta, max_iters, skip_variance, C, nu, eps, kernel_type, dictionary_file, metric_prefix));
+    return rcpp_result_gen;
+END_RCPP
+}
+// fastsk_cross_validate
+DataFrame fastsk_cross_validate(std::string train_file, int g, int m, int nfold, int t, bool approx, double delta, int max_iters, bool skip_variance, double C, double nu, double eps, std::string kernel_type, std::string dictionary_file);
+RcppExport SEXP _FastGKMSVM_fastsk_cross_validate(SEXP train_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP nfoldSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP CSEXP, SEXP nuSEXP, SEXP epsSEXP, SEXP kernel_typeSEXP, SEXP dictionary_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type train_file(train_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type g(gSEXP);
+    Rcpp::traits::input_parameter< int >::type m(mSEXP);
+    Rcpp::traits::input_parameter< int >::type nfold(nfoldSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< bool >::type approx(approxSEXP);
+    Rcpp::traits::input_parameter< double >::type delta(deltaSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iters(max_itersSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_variance(skip_varianceSEXP);
+    Rcpp::traits::input_parameter< double >::type C(CSEXP);
+    Rcpp::traits::input_parameter< double >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel_type(kernel_typeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dictionary_file(dictionary_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(fastsk_cross_validate(train_file, g, m, nfold, t, approx, delta, max_iters, skip_variance, C, nu, eps, kernel_type, dictionary_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// fastsk_save_model
+void fastsk_save_model(std::string train_file, int g, int m, std::string model_file, int t, bool approx, double delta, int max_iters, bool skip_variance, double C, double nu, double eps, std::string kernel_type, std::string dictionary_file);
+RcppExport SEXP _FastGKMSVM_fastsk_save_model(SEXP train_fileSEXP, SEXP gSEXP, SEXP mSEXP, SEXP model_fileSEXP, SEXP tSEXP, SEXP approxSEXP, SEXP deltaSEXP, SEXP max_itersSEXP, SEXP skip_varianceSEXP, SEXP CSEXP, SEXP nuSEXP, SEXP epsSEXP, SEXP kernel_typeSEXP, SEXP dictionary_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type train_file(train_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type g(gSEXP);
+    Rcpp::traits::input_parameter< int >::type m(mSEXP);
+    Rcpp::traits::input_parameter< std::string >::type model_file(model_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< bool >::type approx(approxSEXP);
+    Rcpp::traits::input_parameter< double >::type delta(deltaSEXP);
+    Rcpp::traits::input_parameter< int >::type max_iters(max_itersSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_variance(skip_varianceSEXP);
+    Rcpp::traits::input_parameter< double >::type C(CSEXP);
+    Rcpp::traits::input_parameter< double >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel_type(kernel_typeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dictionary_file(dictionary_fileSEXP);
+    fastsk_save_model(train_file, g, m, model_file, t, approx, delta, max_iters, skip_variance, C, nu, eps, kernel_type, dictionary_file);
+    return R_NilValue;
+END_RCPP
+}
+// fastsk_score_model
+void fastsk_score_model(std::string model_file, std::string test_file, int t, int batch_size);
+RcppExport SEXP _FastGKMSVM_fastsk_score_model(SEXP model_fileSEXP, SEXP test_fileSEXP, SEXP tSEXP, SEXP batch_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type model_file(model_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type test_file(test_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type t(tSEXP);
+    Rcpp::traits::input_parameter< int >::type batch_size(batch_sizeSEXP);
+    fastsk_score_model(model_file, test_file, t, batch_size);
+    return R_NilValue;
+END_RCPP
+}
+// fastsk_read_predictions
+List fastsk_read_predictions(std::string pred_file);
+RcppExport SEXP _FastGKMSVM_fastsk_read_predictions(SEXP pred_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type pred_file(pred_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(fastsk_read_predictions(pred_file));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_FastGKMSVM_fastsk_compute_kernel", (DL_FUNC) &_FastGKMSVM_fastsk_compute_kernel, 11},
+    {"_FastGKMSVM_fastsk_compute_kernel", (DL_FUNC) &_FastGKMSVM_fastsk_compute_kernel, 12},
     {"_FastGKMSVM_fastsk_train_and_score", (DL_FUNC) &_FastGKMSVM_fastsk_train_and_score, 16},
+    {"_FastGKMSVM_fastsk_train_and_score_kernel", (DL_FUNC) &_FastGKMSVM_fastsk_train_and_score_kernel, 8},
+    {"_FastGKMSVM_fastsk_sweep_C", (DL_FUNC) &_FastGKMSVM_fastsk_sweep_C, 14},
+    {"_FastGKMSVM_fastsk_train_and_score_tasks", (DL_FUNC) &_FastGKMSVM_fastsk_train_and_score_tasks, 17},
+    {"_FastGKMSVM_fastsk_cross_validate", (DL_FUNC) &_FastGKMSVM_fastsk_cross_validate, 14},
+    {"_FastGKMSVM_fastsk_save_model", (DL_FUNC) &_FastGKMSVM_fastsk_save_model, 14},
+    {"_FastGKMSVM_fastsk_score_model", (DL_FUNC) &_FastGKMSVM_fastsk_score_model, 4},
+    {"_FastGKMSVM_fastsk_read_predictions", (DL_FUNC) &_FastGKMSVM_fastsk_read_predictions, 1},
     {NULL, NULL, 0}
 };
 
@@ -0,0 +1,52 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/* Blocking single-producer/single-consumer queue holding at most `capacity`
+items, used to connect the stages of the batch scoring pipeline. push blocks
+while the queue is full, so a fast stage can never run more than `capacity`
+items ahead of the stage after it. */
+template <typename T>
+class BoundedQueue {
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+
+public:
+    BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->not_full.wait(guard, [this]() { return this->items.size() < this->capacity; });
+        this->items.push_back(std::move(item));
+        this->not_empty.notify_one();
+    }
+
+    // Signal that no more items will be pushed
+    void close() {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->closed = true;
+        this->not_empty.notify_all();
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->not_empty.wait(guard, [this]() { return !this->items.empty() || this->closed; });
+        if (this->items.empty()) {
+            return false;
+        }
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        this->not_full.notify_one();
+        return true;
+    }
+};
+
+#endif
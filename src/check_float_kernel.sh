@@ -0,0 +1,32 @@
+#!/bin/sh
+# Check that training on the single precision copy of the kernel (--float-kernel)
+# gives the AUROC of the double precision kernel on the EP300 data, within TOL, for
+# the fastsk and linear kernels. The kernel is computed once and reloaded for each run.
+# usage: check_float_kernel.sh <fastsk executable> <data directory>
+
+FASTSK=$1
+DATA=$2
+TOL=${TOL:-0.001}
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+auroc() {
+    "$FASTSK" -q "$@" | sed -n 's/^AUROC: //p'
+}
+
+"$FASTSK" -g 8 -m 4 -q --save-kernel EP300.kernel "$DATA/EP300.train.fasta" "$DATA/EP300.test.fasta" > /dev/null || exit 1
+
+status=0
+for kernel in fastsk linear; do
+    double=$(auroc -r $kernel --load-kernel EP300.kernel)
+    single=$(auroc -r $kernel --load-kernel EP300.kernel --float-kernel)
+    if awk -v a="$double" -v b="$single" -v tol="$TOL" 'BEGIN { d = a - b; if (d < 0) d = -d; exit !(a != "" && b != "" && d <= tol) }'; then
+        echo "ok: $kernel AUROC $double (double), $single (float)"
+    else
+        echo "FAIL: $kernel AUROC $double (double), $single (float), tolerance $TOL"
+        status=1
+    fi
+done
+exit $status
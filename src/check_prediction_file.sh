@@ -0,0 +1,43 @@
+#!/bin/sh
+# Check that --convert-predictions reads a binary predictions file written by
+# --pred-binary, and rejects, rather than reads past, a truncated file and one whose
+# header claims 2^62 predictions without labels.
+# usage: check_prediction_file.sh <fastsk executable> <data directory>
+
+FASTSK=$1
+DATA=$2
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+head -n 400 "$DATA/EP300.train.fasta" > train.fasta
+tail -n 400 "$DATA/EP300.train.fasta" >> train.fasta
+head -n 40 "$DATA/EP300.test.fasta" > test.fasta
+"$FASTSK" -g 6 -m 2 -q --pred-binary train.fasta test.fasta > /dev/null || exit 1
+
+status=0
+if "$FASTSK" --convert-predictions auc_file_one_shot.bin preds.csv > /dev/null && [ "$(wc -l < preds.csv)" -eq 20 ]; then
+    echo "ok: 20 predictions read back"
+else
+    echo "FAIL: the binary predictions file could not be read back"
+    status=1
+fi
+
+# the header is 24 bytes: magic, has_labels, reserved, then the int64 count
+head -c 60 auc_file_one_shot.bin > truncated.bin
+cp auc_file_one_shot.bin corrupt.bin
+printf '\000\000\000\000' | dd of=corrupt.bin bs=1 seek=8 conv=notrunc 2> /dev/null
+printf '\000\000\000\000\000\000\000\100' | dd of=corrupt.bin bs=1 seek=16 conv=notrunc 2> /dev/null
+for file in truncated.bin corrupt.bin; do
+    "$FASTSK" --convert-predictions $file out.csv > /dev/null
+    code=$?
+    # 1 is a reported error; a crash exits with 128 plus the signal
+    if [ $code -eq 1 ]; then
+        echo "ok: $file rejected"
+    else
+        echo "FAIL: $file exited with $code"
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Check that --scan scores a window holding exactly one test sequence with the
+# decision value that batch scoring gives that sequence, for the fastsk and linear
+# kernels. The first test sequences of EP300 are joined into one chromosome and
+# scanned at half a sequence stride, so that the rolling window update is used.
+# usage: check_scan.sh <fastsk executable> <data directory>
+
+FASTSK=$1
+DATA=$2
+TOL=${TOL:-0.0001}
+N=3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+head -n $((2 * N)) "$DATA/EP300.test.fasta" > test.fasta
+awk 'NR % 2 == 0 { s = s $0 } END { print ">chr"; print s }' test.fasta > genome.fa
+len=$(sed -n 2p test.fasta | tr -d '\n' | wc -c)
+
+status=0
+for kernel in fastsk linear; do
+    "$FASTSK" -g 6 -m 2 -q -r $kernel --scan genome.fa --window $len --stride $((len / 2)) \
+        --scan-out scan.bedgraph "$DATA/EP300.train.fasta" > /dev/null || exit 1
+    "$FASTSK" -g 6 -m 2 -q -r $kernel -b $N --top-k $N --top-k-out top.txt \
+        "$DATA/EP300.train.fasta" test.fasta > /dev/null || exit 1
+    # window i * len holds test sequence i; top.txt lists each sequence by index among the highest
+    if awk -v len=$len -v n=$N -v tol="$TOL" '
+        FNR == NR { if ($1 == "high") dec[$3] = $5; next }
+        FNR > 1 && $2 % len == 0 { i = $2 / len; d = $4 - dec[i]; if (d < 0) d = -d
+            if (!(i in dec) || d > tol) bad = 1; seen++ }
+        END { exit !(seen == n && !bad) }' top.txt scan.bedgraph; then
+        echo "ok: $kernel scan scores match the decision values of $N test sequences"
+    else
+        echo "FAIL: $kernel scan scores differ from the decision values, tolerance $TOL"
+        paste scan.bedgraph top.txt
+        status=1
+    fi
+done
+exit $status
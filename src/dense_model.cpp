@@ -0,0 +1,155 @@
+#include "dense_model.hpp"
+#include "shared.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+/* Flatten a trained binary model. K is the packed triangular training kernel
+(only its n_train x n_train training part is read), and is only needed for the
+linear and rbf kernels. */
+DenseModel build_dense_model(const svm_model *model, int kernel_type, double gamma, const double *K, int n_train) {
+    DenseModel dense;
+    if (model->nr_class != 2 || (kernel_type != FASTSK && kernel_type != LINEAR && kernel_type != RBF)) {
+        return dense;
+    }
+
+    dense.kernel_type = kernel_type;
+    dense.n_train = n_train;
+    dense.w.assign(n_train, 0);
+    dense.rho = model->rho[0];
+    dense.label[0] = model->label[0];
+    dense.label[1] = model->label[1];
+    if (model->probA != NULL && model->probB != NULL) {
+        dense.probability = true;
+        dense.probA = model->probA[0];
+        dense.probB = model->probB[0];
+    }
+
+    const double *coef = model->sv_coef[0];
+    double *K_tri = const_cast<double *>(K);
+    if (kernel_type == RBF) {
+        dense.gamma = gamma;
+        dense.coef.assign(coef, coef + model->l);
+        dense.sv_rows.resize((size_t) model->l * n_train);
+        for (int i = 0; i < model->l; i++) {
+            for (int j = 0; j < n_train; j++) {
+                dense.sv_rows[(size_t) i * n_train + j] = tri_access(K_tri, model->sv_indices[i] - 1, j);
+            }
+        }
+    } else if (kernel_type == FASTSK) {
+        for (int i = 0; i < model->l; i++) {
+            dense.w[model->sv_indices[i] - 1] += coef[i];
+        }
+    } else {
+        for (int j = 0; j < n_train; j++) {
+            double sum = 0;
+            for (int i = 0; i < model->l; i++) {
+                sum += coef[i] * tri_access(K_tri, j, model->sv_indices[i] - 1);
+            }
+            dense.w[j] = sum;
+        }
+    }
+    dense.available = true;
+
+    return dense;
+}
+
+/* rbf decision values for the rows of K. Support vectors are taken in blocks small
+enough to stay in cache while every row is scored against them, and four rows are
+scored against a support vector at once, sharing its loads. Each distance and each
+row's sum over the support vectors is accumulated in the same order as libsvm's
+k_function and svm_predict_values, so results are identical. */
+static void rbf_decision_values(const DenseModel &dense, const double *K, long n_rows, double *dec) {
+    long n = dense.n_train;
+    long n_sv = dense.coef.size();
+    const long sv_block = max(1L, (1L << 18) / max(1L, n));
+
+    for (long r = 0; r < n_rows; r++) {
+        dec[r] = 0;
+    }
+    for (long s0 = 0; s0 < n_sv; s0 += sv_block) {
+        long s1 = min(n_sv, s0 + sv_block);
+        long r = 0;
+        for (; r + 4 <= n_rows; r += 4) {
+            const double *x0 = K + r * n, *x1 = x0 + n, *x2 = x1 + n, *x3 = x2 + n;
+            for (long s = s0; s < s1; s++) {
+                const double *sv = &dense.sv_rows[s * n];
+                double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+                for (long j = 0; j < n; j++) {
+                    double e0 = x0[j] - sv[j], e1 = x1[j] - sv[j];
+                    double e2 = x2[j] - sv[j], e3 = x3[j] - sv[j];
+                    d0 += e0 * e0;
+                    d1 += e1 * e1;
+                    d2 += e2 * e2;
+                    d3 += e3 * e3;
+                }
+                dec[r] += dense.coef[s] * exp(-dense.gamma * d0);
+                dec[r + 1] += dense.coef[s] * exp(-dense.gamma * d1);
+                dec[r + 2] += dense.coef[s] * exp(-dense.gamma * d2);
+                dec[r + 3] += dense.coef[s] * exp(-dense.gamma * d3);
+            }
+        }
+        for (; r < n_rows; r++) {
+            const double *x = K + r * n;
+            for (long s = s0; s < s1; s++) {
+                const double *sv = &dense.sv_rows[s * n];
+                double d = 0;
+                for (long j = 0; j < n; j++) {
+                    double e = x[j] - sv[j];
+                    d += e * e;
+                }
+                dec[r] += dense.coef[s] * exp(-dense.gamma * d);
+            }
+        }
+    }
+    for (long r = 0; r < n_rows; r++) {
+        dec[r] -= dense.rho;
+    }
+}
+
+/* dec[r] = <K[r], w> - rho for each of the n_rows rows of the dense
+n_rows x n_train block K. The columns are accumulated in four independent
+partial sums so the compiler can map them onto SIMD lanes without needing to
+reassociate floating point additions. */
+void dense_decision_values(const DenseModel &dense, const double *K, long n_rows, double *dec) {
+    if (dense.kernel_type == RBF) {
+        rbf_decision_values(dense, K, n_rows, dec);
+        return;
+    }
+    long n = dense.n_train;
+    const double *w = dense.w.data();
+
+    for (long r = 0; r < n_rows; r++) {
+        const double *row = K + r * n;
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        long j = 0;
+        for (; j + 4 <= n; j += 4) {
+            s0 += row[j] * w[j];
+            s1 += row[j + 1] * w[j + 1];
+            s2 += row[j + 2] * w[j + 2];
+            s3 += row[j + 3] * w[j + 3];
+        }
+        for (; j < n; j++) {
+            s0 += row[j] * w[j];
+        }
+        dec[r] = (s0 + s1) + (s2 + s3) - dense.rho;
+    }
+}
+
+// Platt probability of label[0] for a decision value, as in svm_predict_probability
+double dense_probability(const DenseModel &dense, double dec) {
+    if (!dense.probability) {
+        return (dec > 0) ? 1 : 0;
+    }
+    return svm_binary_probability(dec, dense.probA, dense.probB);
+}
+
+// Predicted label, matching svm_predict_probability (or svm_predict without probabilities)
+double dense_label(const DenseModel &dense, double dec, double prob_first) {
+    if (!dense.probability) {
+        return (dec > 0) ? dense.label[0] : dense.label[1];
+    }
+    return (1 - prob_first > prob_first) ? dense.label[1] : dense.label[0];
+}
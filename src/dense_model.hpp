@@ -0,0 +1,37 @@
+#ifndef DENSE_MODEL_H
+#define DENSE_MODEL_H
+
+#include <vector>
+#include "libsvm-code/svm.h"
+
+using namespace std;
+
+/* A binary svm_model flattened for batched prediction from a dense test kernel
+block. For the fastsk kernel the decision value of a test row k is
+sum_i coef_i * k[sv_i] - rho; for the linear kernel it is
+sum_i coef_i * <k, K[sv_i]> - rho = <k, K * coef> - rho. Either way it is a single
+dot product between the row and a weight vector over the training sequences, so
+a whole batch is one matrix-vector product. The rbf kernel is not linear in the
+row, so its model keeps the kernel rows of the support vectors instead. Decision
+values follow libsvm's orientation: positive means label[0]. */
+typedef struct DenseModel {
+    bool available = false;         // false for models with more than two classes
+    int kernel_type = LINEAR;
+    int n_train = 0;
+    vector<double> w;               // weight of each training sequence (fastsk and linear)
+    vector<double> coef;            // coefficient of each support vector (rbf)
+    vector<double> sv_rows;         // kernel row of each support vector, n_sv x n_train (rbf)
+    double gamma = 0;
+    double rho = 0;
+    int label[2] = {1, -1};
+    bool probability = false;       // whether probA and probB hold a Platt sigmoid
+    double probA = 0;
+    double probB = 0;
+} DenseModel;
+
+DenseModel build_dense_model(const svm_model *, int, double, const double *, int);
+void dense_decision_values(const DenseModel &, const double *, long, double *);
+double dense_probability(const DenseModel &, double);
+double dense_label(const DenseModel &, double, double);
+
+#endif
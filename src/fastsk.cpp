@@ -1,5 +1,15 @@
 #include "fastsk.hpp"
 #include "fastsk_kernel.hpp"
+#include "gmer_weights.hpp"
+#include "sequence_source.hpp"
+#include "bounded_queue.hpp"
+#include "reorder_buffer.hpp"
+#include "metrics.hpp"
+#include "prediction_file.hpp"
+#include "top_scores.hpp"
+#include "gram_matrix.hpp"
+#include "model_bundle.hpp"
+#include "kernel_file.hpp"
 #include "utils.hpp"
 #include "shared.h"
 #include "libsvm-code/svm.h"
@@ -11,8 +21,14 @@
 #include <cstring>
 #include <assert.h>
 #include <map>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <climits>
 // #include <Rcpp.h>
 #include <iostream>
+#include <fstream>
 
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 
@@ -30,7 +46,13 @@ FastSK::FastSK(int g, int m, int t, bool approx, double delta, int max_iters, bo
 }
 
 void FastSK::free_kernel() {
-    free(this->K);
+    if (this->kernel_file != NULL) {
+        delete this->kernel_file;
+        this->kernel_file = NULL;
+    } else {
+        free(this->K);
+    }
+    this->K = NULL;
 }
 
 void FastSK::compute_kernel(const string train_file, const string test_file) {
@@ -45,35 +67,37 @@ void FastSK::compute_kernel(const string train_file, const string test_file, con
 
     data_reader->read_data(train_file, train);
     data_reader->read_data(test_file, !train);
-    vector<vector<int> > train_seq = data_reader->train_seq;
-    vector<vector<int> > test_seq = data_reader->test_seq;
 
     this->train_labels = data_reader->train_labels.data();
     this->test_labels = data_reader->test_labels.data();
+    this->dictmap = data_reader->dictmap;
 
-    this->compute_kernel(train_seq, test_seq);
+    this->compute_kernel(data_reader->train_seq, data_reader->test_seq);
 }
-void FastSK::compute_kernel(vector<vector<int> > Xtrain, vector<vector<int> > Xtest, int *train_labels, int *test_labels) {
+void FastSK::compute_kernel(const SequenceSet &Xtrain, const SequenceSet &Xtest, int *train_labels, int *test_labels) {
     this->train_labels = train_labels;
     this->test_labels = test_labels;
 
     this->compute_kernel(Xtrain, Xtest);
 }
 
-void FastSK::compute_kernel(vector<vector<int> > Xtrain, vector<vector<int> > Xtest) {
+void FastSK::compute_kernel(const SequenceSet &Xtrain, const SequenceSet &Xtest) {
     // Given sequences already in numerical form, compute the kernel matrix
+    if (&Xtrain != &this->Xtrain) {
+        this->Xtrain = Xtrain;
+    }
     vector<int> lengths;
-    int shortest_train = Xtrain[0].size();
+    int shortest_train = Xtrain.length(0);
     for (unsigned long i = 0; i < Xtrain.size(); i++) {
-        int len = Xtrain[i].size();
+        int len = Xtrain.length(i);
         if (len < shortest_train) {
             shortest_train = len;
         }
         lengths.push_back(len);
     }
-    int shortest_test = Xtest[0].size();
+    int shortest_test = Xtest.length(0);
     for (unsigned long i = 0; i < Xtest.size(); i++) {
-        int len = Xtest[i].size();
+        int len = Xtest.length(i);
         if (len < shortest_test) {
             shortest_test = len;
         }
@@ -98,20 +122,20 @@ void FastSK::compute_kernel(vector<vector<int> > Xtrain, vector<vector<int> > Xt
     this->n_str_test = n_str_test;
     this->total_str = total_str;
 
-    int **S = (int **) malloc(total_str * sizeof(int*));
+    const uint8_t **S = (const uint8_t **) malloc(total_str * sizeof(uint8_t*));
 
     set<int> dict;
     dict.insert(0);
     for (int i = 0; i < n_str_train; i++) {
-        S[i] = Xtrain[i].data();
+        S[i] = Xtrain.data(i);
         for (int j = 0; j < lengths[i]; j++) {
-            dict.insert(Xtrain[i][j]);
+            dict.insert(S[i][j]);
         }
     }
     for (int i = 0; i < n_str_test; i++) {
-        S[n_str_train + i] = Xtest[i].data();
+        S[n_str_train + i] = Xtest.data(i);
         for (int j = 0; j < lengths[n_str_train + i]; j++) {
-            dict.insert(Xtest[i][j]);
+            dict.insert(S[n_str_train + i][j]);
         }
     }
     int dict_size = dict.size();
@@ -149,18 +173,22 @@ void FastSK::compute_kernel(vector<vector<int> > Xtrain, vector<vector<int> > Xt
 
     this->K = K;
     this->stdevs = kernel_function->stdevs;
+    this->nfeat = nfeat;
 }
 
-void FastSK::compute_train(vector<vector<int> > Xtrain, int *train_labels) {
+void FastSK::compute_train(const SequenceSet &Xtrain, int *train_labels) {
     this->train_labels = train_labels;
     this->compute_train(Xtrain);
 }
 
-void FastSK::compute_train(vector<vector<int> > Xtrain) {
+void FastSK::compute_train(const SequenceSet &Xtrain) {
+    if (&Xtrain != &this->Xtrain) {
+        this->Xtrain = Xtrain;
+    }
     vector<int> lengths;
-    int shortest_train = Xtrain[0].size();
-    for (int i = 0; i < Xtrain.size(); i++) {
-        int len = Xtrain[i].size();
+    int shortest_train = Xtrain.length(0);
+    for (size_t i = 0; i < Xtrain.size(); i++) {
+        int len = Xtrain.length(i);
         if (len < shortest_train) {
             shortest_train = len;
         }
@@ -178,14 +206,14 @@ void FastSK::compute_train(vector<vector<int> > Xtrain) {
     this->n_str_train = n_str_train;
     this->n_str_test = n_str_test;
 
-    int **S = (int **) malloc(total_str * sizeof(int*));
+    const uint8_t **S = (const uint8_t **) malloc(total_str * sizeof(uint8_t*));
 
     set<int> dict;
     dict.insert(0);
     for (int i = 0; i < n_str_train; i++) {
-        S[i] = Xtrain[i].data();
+        S[i] = Xtrain.data(i);
         for (int j = 0; j < lengths[i]; j++) {
-            dict.insert(Xtrain[i][j]);
+            dict.insert(S[i][j]);
         }
     }
 
@@ -226,46 +254,281 @@ void FastSK::compute_train(vector<vector<int> > Xtrain) {
     this->nfeat = nfeat;
 }
 
-void FastSK::batch_score(vector<vector<int> > Xtrain, vector<vector<int> > Xtest, int* train_labels, int* test_labels, int batch_size, double C, double nu, double eps, const string kernel_type) {
+// Characters of the alphabet in code order; code 0 is reserved for unknown characters
+static vector<char> code_alphabet(const map<char, int> &dictmap) {
+    int alphabet_size = 0;
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        alphabet_size = max(alphabet_size, it->second);
+    }
+    vector<char> alphabet(alphabet_size + 1, 'N');
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        if (it->second > 0) alphabet[it->second] = it->first;
+    }
+    return alphabet;
+}
+
+/* Open a predictions file, which receives one "label,probability" line per test
+sequence, or the binary layout of prediction_file.hpp under the same name with a
+.bin extension */
+PredictionWriter *FastSK::open_predictions(const string outfile) {
+    if (!this->binary_predictions) {
+        return new PredictionWriter(outfile, false, true);
+    }
+    string path = outfile;
+    size_t dot = path.rfind('.');
+    if (dot != string::npos && path.find('/', dot) == string::npos) {
+        path.erase(dot);
+    }
+    return new PredictionWriter(path + ".bin", true, this->prediction_labels);
+}
+
+// Write predictions as binary float32 scores, with or without the int8 labels
+void FastSK::set_binary_predictions(bool binary, bool labels) {
+    this->binary_predictions = binary;
+    this->prediction_labels = labels;
+}
+
+void FastSK::set_single_precision(bool single_precision) {
+    this->single_precision = single_precision;
+}
+
+// Symbol codes of the sequences, which are saved with the model
+void FastSK::set_dictionary(const map<char, int> &dictmap) {
+    this->dictmap = dictmap;
+}
+
+void FastSK::batch_score(const SequenceSet &Xtrain, const SequenceSet &Xtest, int* train_labels, int* test_labels, int batch_size, double C, double nu, double eps, const string kernel_type) {
+    VectorSource source(Xtest, test_labels);
+    this->batch_score(Xtrain, train_labels, source, batch_size, C, nu, eps, kernel_type);
+}
+
+/* Batch scoring runs as a three stage pipeline: a reader thread pulls the next
+batch from the source while this thread computes the kernel of the current batch
+and a predictor thread scores the previous one. The stages are connected by
+queues holding a single batch, so at most a few batches of sequences and kernel
+blocks are in memory however large the test set is. */
+void FastSK::batch_score(const SequenceSet &Xtrain, int* train_labels, SequenceSource &source, int batch_size, double C, double nu, double eps, const string kernel_type) {
 
     this->train_labels = train_labels;
     this->compute_train(Xtrain);
     this->fit(C, nu, eps, kernel_type);
 
-    this->train_labels = train_labels;
+    this->score_stream(source, batch_size);
+}
+
+/* Score the test sequences of source in batches with the current model, which is
+either trained by fit or read by load_model. */
+void FastSK::score_stream(SequenceSource &source, int batch_size) {
+    // with a memory budget, batches are as large as the budget allows, -b only caps them
+    SequenceSource *input = &source;
+    BudgetSource *budgeted = NULL;
+    if (this->mem_budget > 0) {
+        double available = this->mem_budget - this->batch_fixed_bytes();
+        if (available <= 0) {
+            printf("Error: the memory budget (%.0f MB) does not cover the %.0f MB needed for the training set\n",
+                this->mem_budget / (1 << 20), this->batch_fixed_bytes() / (1 << 20));
+            exit(1);
+        }
+        budgeted = new BudgetSource(source, [this](int len) { return this->batch_seq_bytes(len); }, available);
+        input = budgeted;
+        if (batch_size <= 0) {
+            batch_size = INT_MAX;
+        }
+    }
 
-    int i = 0; 
-    while (i < (int) Xtest.size()) {
-        vector<vector<int> > test_batch;
+    BoundedQueue<ScoreBatch*> to_kernel(1);
+    BoundedQueue<ScoreBatch*> to_predict(1);
 
-        for (int j = 0; j < min((int) Xtest.size() - i, batch_size); j++) {
-            test_batch.push_back(Xtest[i + j]);
+    std::thread reader([&]() {
+        while (true) {
+            ScoreBatch *batch = new ScoreBatch();
+            if (input->next_batch(batch->seqs, batch->labels, batch_size) == 0) {
+                delete batch;
+                break;
+            }
+            to_kernel.push(batch);
         }
-        this->test_labels = (test_labels + i);
-        this->compute_kernel_batch(Xtrain, test_batch); 
-        this->predict("auc");
+        to_kernel.close();
+    });
+
+    // predictions of all batches go to one file and are evaluated together,
+    // unless only the top scoring sequences are kept
+    bool top_k = this->top_k > 0;
+    int num_threads = (this->num_threads == -1) ? 20 : max(1, this->num_threads);
+    TopScores top(this->top_k, num_threads);
+    PredictionWriter *auc_file = top_k ? NULL : this->open_predictions("auc_pred_file.txt");
+    MetricsAccumulator metrics;
+    std::thread predictor([&]() {
+        ScoreBatch *batch;
+        long first_index = 0;
+        while (to_predict.pop(batch)) {
+            if (top_k) {
+                this->top_k_batch(batch->K, batch->seqs, first_index, top);
+            } else {
+                this->predict_batch(batch->K, batch->labels.size(), batch->labels.data(), metrics, *auc_file);
+            }
+            first_index += batch->labels.size();
+            delete batch;
+        }
+    });
+
+    ScoreBatch *batch;
+    while (to_kernel.pop(batch)) {
+        batch->K = this->batch_kernel(this->Xtrain, batch->seqs);
+        // the sequences are not needed for prediction, only to report the top scoring ones
+        if (!top_k) {
+            SequenceSet().swap(batch->seqs);
+        }
+        to_predict.push(batch);
+    }
+    to_predict.close();
+
+    reader.join();
+    predictor.join();
+    delete budgeted;
+
+    if (top_k) {
+        top.write(this->top_k_file, this->alphabet);
+    } else {
+        delete auc_file;
+        this->report(metrics, "auc");
+    }
+}
+
+/* Only keep the k highest and k lowest scoring sequences of batch scoring, by
+decision value oriented so that positive means label 1, and write them to outfile
+instead of the per-sequence predictions. */
+void FastSK::set_top_k(int k, const string outfile, const map<char, int> &dictmap) {
+    this->top_k = k;
+    this->top_k_file = outfile;
+    this->alphabet = code_alphabet(dictmap);
+}
+
+/* Offer each sequence of a batch, given with its dense n_batch x n_train kernel block
+K, to the top-k heaps, then free K. The threads claim chunks of rows as in
+predict_rows, and each offers its rows to its own pair of heaps. first_index is the
+position of the batch in the test stream. */
+void FastSK::top_k_batch(double *K, const SequenceSet &seqs, long first_index, TopScores &top) {
+    int n_str_train = this->n_str_train;
+    int n_rows = seqs.size();
+    const int *label = this->dense_model.available ? this->dense_model.label : this->model->label;
+    double sign = (label[0] == 1) ? 1 : -1;
+
+    const int chunk_size = 256;
+    int num_chunks = (n_rows + chunk_size - 1) / chunk_size;
+    int num_threads = max(1, min((int) top.highest.size(), num_chunks));
+
+    std::atomic<int> next_chunk(0);
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+        threads.push_back(std::thread([&, tid]() {
+            const DenseModel &dense = this->dense_model;
+            struct svm_node *x = NULL;
+            if (!dense.available) {
+                x = Malloc(struct svm_node, n_str_train + 1);
+                for (int j = 0; j < n_str_train; j++) {
+                    x[j].index = j + 1;
+                }
+                x[n_str_train].index = -1;
+            }
+            vector<double> dec(chunk_size);
+
+            int c;
+            while ((c = next_chunk++) < num_chunks) {
+                int start = c * chunk_size;
+                int end = min(n_rows, start + chunk_size);
+                if (dense.available) {
+                    dense_decision_values(dense, K + (long) start * n_str_train, end - start, dec.data());
+                } else {
+                    for (int i = start; i < end; i++) {
+                        for (int j = 0; j < n_str_train; j++) {
+                            x[j].value = K[(long) i * n_str_train + j];
+                        }
+                        svm_predict_values(this->model, x, &dec[i - start]);
+                    }
+                }
+                for (int i = start; i < end; i++) {
+                    top.add(tid, sign * dec[i - start], first_index + i, seqs.data(i), seqs.length(i));
+                }
+            }
+            free(x);
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    free(K);
+}
 
-        i += batch_size;
+// Memory budget for batch scoring, in bytes
+void FastSK::set_mem_budget(double mem_budget) {
+    this->mem_budget = mem_budget;
+}
+
+/* Estimated memory of batch scoring that does not depend on the batch: the training
+kernel, the training g-mers, and the sorted training projection that each kernel
+thread holds (see KernelFunction::compute_test_kernel). Requires compute_train or
+load_model, which has no training kernel. */
+double FastSK::batch_fixed_bytes() {
+    double n_train = this->n_str_train;
+    double n_train_feat = 0;
+    double train_len = 0;
+    for (size_t i = 0; i < this->Xtrain.size(); i++) {
+        int len = this->Xtrain.length(i);
+        train_len += len;
+        n_train_feat += (len >= this->g) ? len - this->g + 1 : 0;
     }
-    
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    double gmer_bytes = sizeof(string) + ((this->g >= 16) ? this->g + 1 : 0);
+
+    double bytes = (this->K != NULL) ? 8 * n_train * (n_train + 1) / 2 : 0;      // training kernel
+    bytes += train_len + sizeof(long int) * (n_train + 1);                 // sequences, one byte per symbol
+    bytes += n_train_feat * (gmer_bytes + sizeof(int));                    // training g-mers
+    bytes += num_threads * n_train_feat * (2 * sizeof(string) + 2 * sizeof(int));   // projections
+    return bytes;
+}
+
+/* Estimated memory one test sequence of the given length adds to a batch. Up to
+three batches of sequences and three kernel blocks are alive in the pipeline at
+once (being read, queued, in the kernel or prediction stage), and the g-mers of the
+batch in the kernel stage are held in several forms while they are deduplicated. */
+double FastSK::batch_seq_bytes(int length) {
+    double n_feat = (length >= this->g) ? length - this->g + 1 : 0;
+    double gmer_bytes = sizeof(string) + ((this->g >= 16) ? this->g + 1 : 0);
+
+    double bytes = 3 * (length + sizeof(long int));                        // sequence and its offset
+    bytes += n_feat * (2 * gmer_bytes + 7 * sizeof(int));                  // g-mers, owners and row blocks
+    bytes += 3 * 8.0 * this->n_str_train;                                  // kernel rows
+    bytes += 2 * sizeof(double) + 3 * sizeof(double) + sizeof(int);         // predictions
+    return bytes;
+}
+
+void FastSK::compute_kernel_batch(const SequenceSet &Xtrain, const SequenceSet &Xbatch) {
+    this->K = this->batch_kernel(Xtrain, Xbatch);
+    this->total_str = Xtrain.size() + Xbatch.size();
+    this->n_str_train = Xtrain.size();
+    this->n_str_test = Xbatch.size();
 }
 
-void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int>> Xbatch) {
+// Kernel between a batch of test sequences and the training sequences, as a dense
+// n_batch x n_train row-major matrix. Does not modify the state of this object so
+// it can run concurrently with predict_batch on another batch.
+double* FastSK::batch_kernel(const SequenceSet &Xtrain, const SequenceSet &Xbatch) {
 
     vector<int> sv_lengths;
     vector<int> test_lengths;
 
-    int shortest_train = Xtrain[0].size();
+    int shortest_train = Xtrain.length(0);
     for (unsigned long i = 0; i < Xtrain.size(); i++) {
-        int len = Xtrain[i].size();
+        int len = Xtrain.length(i);
         if (len < shortest_train) {
             shortest_train = len;
         }
         sv_lengths.push_back(len);
     }
-    int shortest_test = Xbatch[0].size();
+    int shortest_test = Xbatch.length(0);
     for (unsigned long i = 0; i < Xbatch.size(); i++) {
-        int len = Xbatch[i].size();
+        int len = Xbatch.length(i);
         if (len < shortest_test) {
             shortest_test = len;
         }
@@ -282,15 +545,6 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
         g_greater_than_shortest_test(this->g, shortest_test);
     }
 
-    vector<string> train_seqs;
-    for (int i=0; i < (int) Xtrain.size(); i++) {
-        string train_seq;
-        for (int j = 0; j < (int) Xtrain[i].size(); j++) {
-            train_seq.append(to_string(Xtrain[i][j]));
-        }
-        train_seqs.push_back(train_seq);
-    }
-
     cout << "Done obtaining training sequences\n";
 
     int n_train_feat = 0;
@@ -303,10 +557,12 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
     int *train_groups = (int *) malloc(n_train_feat * sizeof(int));
     string *train_features = new string[n_train_feat];
 
+    // g-mers are compared as strings holding one byte per symbol
     int c = 0;
-    for (int i = 0; i < (int) train_seqs.size(); i++) {
-        for (int j = 0; j < (int) train_seqs[i].size() - this->g + 1; j++) {
-            train_features[c] = train_seqs[i].substr(j, this->g);
+    for (int i = 0; i < (int) Xtrain.size(); i++) {
+        const char *seq = (const char *) Xtrain.data(i);
+        for (int j = 0; j < sv_lengths[i] - this->g + 1; j++) {
+            train_features[c].assign(seq + j, this->g);
             train_groups[c] = i;
             c++;
         }
@@ -317,16 +573,6 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
         printf("Done with train sequences...\n");
     }
 
-    vector<string> test_sequences;
-    for (int i=0; i < (int) Xbatch.size(); i++) {
-        string sequence;
-        for (int j = 0; j < (int) Xbatch[i].size(); j++) {
-            sequence.append(to_string(Xbatch[i][j]));
-        }
-        test_sequences.push_back(sequence);
-    }
-
-
     int n_test_feat = 0;
     for (int i = 0; i < (int) Xbatch.size(); i++) {
         n_test_feat += (test_lengths[i] >= this->g) ? (test_lengths[i] - this->g + 1) : 0;
@@ -334,14 +580,15 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
 
 
     printf("Number of features: %d\n", n_test_feat);
-    int *test_groups = (int *) malloc(n_test_feat * sizeof(int));
-    string *test_features = new string[n_test_feat];
+    string *test_gmers = new string[n_test_feat];
+    int *test_gmer_rows = (int *) malloc(n_test_feat * sizeof(int));
 
     c = 0;
-    for (int i = 0; i < (int) test_sequences.size(); i++) {
-        for (int j = 0; j < (int) test_sequences[i].size() - this->g + 1; j++) {
-            test_features[c] = test_sequences[i].substr(j, this->g);
-            test_groups[c] = i;
+    for (int i = 0; i < (int) Xbatch.size(); i++) {
+        const char *seq = (const char *) Xbatch.data(i);
+        for (int j = 0; j < test_lengths[i] - this->g + 1; j++) {
+            test_gmers[c].assign(seq + j, this->g);
+            test_gmer_rows[c] = i;
             c++;
         }
     }
@@ -351,10 +598,45 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
         printf("Done with test batch sequences...\n");
     }
 
-    BatchFeature *features = (BatchFeature *) malloc(sizeof(BatchFeature));
+    /* Collapse identical test g-mers. Short test sequences, such as an enumeration
+    of all k-mers, share most of their g-mers with other rows of the batch, so each
+    distinct g-mer is matched against the training set once and its counts are
+    scattered to every row it occurs in. */
+    vector<int> order(n_test_feat);
+    for (int i = 0; i < n_test_feat; i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(),
+        [test_gmers](int left, int right) { return test_gmers[left] < test_gmers[right]; });
+
+    int n_distinct = 0;
+    for (int i = 0; i < n_test_feat; i++) {
+        if (i == 0 || test_gmers[order[i]] != test_gmers[order[i - 1]]) {
+            n_distinct++;
+        }
+    }
+    string *test_features = new string[n_distinct];
+    int *test_group_start = (int *) malloc((n_distinct + 1) * sizeof(int));
+    int *test_groups = (int *) malloc(n_test_feat * sizeof(int));
+    int d = -1;
+    for (int i = 0; i < n_test_feat; i++) {
+        if (i == 0 || test_gmers[order[i]] != test_gmers[order[i - 1]]) {
+            d++;
+            test_features[d] = test_gmers[order[i]];
+            test_group_start[d] = i;
+        }
+        test_groups[i] = test_gmer_rows[order[i]];
+    }
+    test_group_start[n_distinct] = n_test_feat;
+    delete[] test_gmers;
+    free(test_gmer_rows);
+    printf("%d distinct test features\n", n_distinct);
+
+    BatchFeature *features = new BatchFeature();
     (*features).test_features = test_features;
     (*features).test_groups = test_groups;
-    (*features).n_test_feat = n_test_feat;
+    (*features).test_group_start = test_group_start;
+    (*features).n_test_feat = n_distinct;
     (*features).train_features = train_features;
     (*features).train_groups = train_groups;
     (*features).n_train_feat = n_train_feat;
@@ -377,18 +659,12 @@ void FastSK::compute_kernel_batch(vector<vector<int> > Xtrain, vector<vector<int
     params.max_iters = this->max_iters;
     params.skip_variance = this->skip_variance;
 
-    this->total_str = params.total_str;
-    this->n_str_train = params.n_str_train;
-    this->n_str_test = params.n_str_test;
-
     KernelFunction* kernel_function = new KernelFunction(&params);
     double *K = kernel_function->compute_test_kernel();
-    free(features);
-
-    this->K = K;
-    this->stdevs = kernel_function->stdevs;
-    this->nfeat = n_train_feat + n_test_feat;
+    delete features;
+    delete kernel_function;
 
+    return K;
 }
 
 vector<vector<double> > FastSK::get_train_kernel() {
@@ -424,6 +700,10 @@ vector<double> FastSK::get_stdevs() {
     return this->stdevs;
 }
 
+map<char, int> FastSK::get_dictionary() {
+    return this->dictmap;
+}
+
 void FastSK::save_kernel(string kernel_file) {
     double *K = this->K;
     int total_str = this->n_str_train + this->n_str_test;
@@ -440,15 +720,64 @@ void FastSK::save_kernel(string kernel_file) {
     }
 }
 
-void FastSK::fit(double C, double nu, double eps, const string kernel_type) {
-    // if ((this->kernel_type == LINEAR || this->kernel_type == RBF) && test_file.empty()) {
-    //     printf("A test file must be provided for kernel type '%s'\n", this->kernel_type_name.c_str());
-    //     exit(1);
-    // }
+/* Write the kernel and the labels in the binary format of kernel_file.hpp, which
+holds the packed triangle as it is in memory and so is much smaller and faster to
+write than the text of save_kernel. */
+void FastSK::save_binary_kernel(const string kernel_file) {
+    if (this->K == NULL) {
+        printf("Error: there is no kernel to save\n");
+        exit(1);
+    }
+    KernelHeader header;
+    memset(&header, 0, sizeof(header));
+    header.g = this->g;
+    header.m = this->m;
+    header.n_train = this->n_str_train;
+    header.n_test = this->n_str_test;
+    header.nfeat = this->nfeat;
+    write_kernel_file(kernel_file, header, this->train_labels, this->test_labels, this->K);
+}
 
-    this->C = C;
-    this->nu = nu;
-    this->eps = eps;
+/* Replace the kernel and the labels with those of a file written by
+save_binary_kernel, so that fit and score run without computing the kernel. K
+points into the mapping of the file rather than a copy, so only the pages libsvm
+touches are read. The training sequences are not in the file, so the model cannot
+be saved or used for batch scoring. */
+void FastSK::load_kernel(const string kernel_file) {
+    KernelFile *file = new KernelFile(kernel_file);
+    this->free_kernel();
+    this->kernel_file = file;
+    const KernelHeader *header = file->header;
+    this->g = header->g;
+    this->m = header->m;
+    this->k = header->g - header->m;
+    this->n_str_train = header->n_train;
+    this->n_str_test = header->n_test;
+    this->total_str = header->n_train + header->n_test;
+    this->nfeat = header->nfeat;
+    this->train_labels = file->labels;
+    this->test_labels = file->labels + header->n_train;
+    this->K = file->K;
+    this->Xtrain = SequenceSet();
+    this->Xtest = SequenceSet();
+    if (!this->quiet) {
+        printf("Loaded a kernel of %ld training and %ld test sequences (g = %d, m = %d) from %s\n",
+            this->n_str_train, this->n_str_test, this->g, this->m, kernel_file.c_str());
+    }
+}
+
+// Free a problem from create_svm_problem; x[0] is the start of its node storage
+static void free_svm_problem(svm_problem *prob) {
+    if (prob == NULL) {
+        return;
+    }
+    free(prob->x[0]);
+    free(prob->x);
+    free(prob->y);
+    free(prob);
+}
+
+void FastSK::set_kernel_type(const string kernel_type) {
     if (kernel_type == "linear") {
         this->kernel_type = LINEAR;
         this->kernel_type_name = "linear";
@@ -462,14 +791,10 @@ void FastSK::fit(double C, double nu, double eps, const string kernel_type) {
         printf("Error: kernel must be: 'linear', 'fastsk', or 'rbf'\n");
         exit(1);
     }
+}
 
-    int g = this->g;
-    int m = this->m;
-    bool quiet = false;
-    int n_str_train = this->n_str_train;
-    int n_str_test = this->n_str_test;
-    int nfeat = this->nfeat;
-
+// libsvm parameters for the current settings, to be freed by the caller
+svm_parameter* FastSK::create_svm_parameter() {
     struct svm_parameter* svm_param = Malloc(svm_parameter, 1);
     svm_param->svm_type = this->svm_type;
     svm_param->kernel_type = this->kernel_type;
@@ -484,83 +809,620 @@ void FastSK::fit(double C, double nu, double eps, const string kernel_type) {
     svm_param->probability = this->probability;
     svm_param->eps = this->eps;
     svm_param->degree = 0;
+    svm_param->nr_thread = (this->num_threads == -1) ? 20 : this->num_threads;
+    svm_param->kernel_matrix_float = NULL;
+    return svm_param;
+}
+
+/* The linear and rbf kernels take the training kernel rows as feature vectors.
+Rather than have libsvm take dot products of those rows for every Q column, the
+whole second level kernel is computed up front and libsvm treats it as a
+precomputed kernel, like the fastsk one. The model then has no feature vectors,
+so this needs the dense model for prediction, which only handles two classes.
+Returns that kernel, packed, and switches svm_param to it; or NULL when libsvm
+should train on K itself. If columns is not NULL, the feature vectors only hold
+the columns of the training sequences with columns[i] set (see linear_gram). */
+double* FastSK::second_level_kernel(svm_parameter *svm_param, int num_classes, const char *columns) {
+    int n_str_train = this->n_str_train;
+    if (this->kernel_type == FASTSK || num_classes > 2) {
+        return NULL;
+    }
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    double *gram = linear_gram(this->K, n_str_train, num_threads, columns);
+    if (this->kernel_type == RBF) {
+        rbf_from_gram(gram, n_str_train, svm_param->gamma);
+    }
+    svm_param->kernel_type = FASTSK;
+    return gram;
+}
+
+/* With single precision set, a float copy of the packed kernel that svm_param
+trains on (the fastsk kernel or the second level one), which libsvm then reads
+in place of it: building a Q column reads half as many bytes, while the gradients
+are still accumulated in double. Returns the copy, to be freed by the caller once
+training is done, or NULL. */
+float* FastSK::single_precision_kernel(svm_parameter *svm_param) {
+    if (!this->single_precision || svm_param->kernel_type != FASTSK) {
+        return NULL;
+    }
+    long n_str_train = this->n_str_train;
+    long size = n_str_train * (n_str_train + 1) / 2;
+    float *K_float = (float *) malloc(sizeof(float) * size);
+    for (long i = 0; i < size; i++) {
+        K_float[i] = (float) svm_param->kernel_matrix[i];
+    }
+    svm_param->kernel_matrix_float = K_float;
+    return K_float;
+}
 
-    svm_problem *prob;
-    struct svm_model *model;
+void FastSK::fit(double C, double nu, double eps, const string kernel_type) {
+    // if ((this->kernel_type == LINEAR || this->kernel_type == RBF) && test_file.empty()) {
+    //     printf("A test file must be provided for kernel type '%s'\n", this->kernel_type_name.c_str());
+    //     exit(1);
+    // }
 
-    prob = this->create_svm_problem(this->K, this->train_labels, svm_param);
-    model = this->train_model(this->K, this->train_labels, svm_param);
+    this->C = C;
+    this->nu = nu;
+    this->eps = eps;
+    this->set_kernel_type(kernel_type);
+    int n_str_train = this->n_str_train;
+    struct svm_parameter* svm_param = this->create_svm_parameter();
 
-    this->model = model;
+    // a previous fit's model points into its problem, so both go together
+    if (this->model != NULL) {
+        svm_free_and_destroy_model(&this->model);
+    }
+    free_svm_problem(this->problem);
+
+    set<int> classes(this->train_labels, this->train_labels + n_str_train);
+    double *gram = this->second_level_kernel(svm_param, classes.size(), NULL);
+    double gamma = svm_param->gamma;
+
+    this->problem = this->create_svm_problem((gram != NULL) ? gram : this->K, this->train_labels, svm_param);
+    float *K_float = this->single_precision_kernel(svm_param);
+    this->model = this->train_model(this->problem, svm_param, NULL);
+    this->dense_model = build_dense_model(this->model, this->kernel_type, gamma, this->K, this->n_str_train);
+    free(gram);
+    free(K_float);
 }
 
-svm_model* FastSK::train_model(double *K, int *labels, svm_parameter *svm_param) {
+/* Train and evaluate a model for each value in Cs on the test sequences of the
+one-shot kernel, building the training problem and the test kernel block once.
+The values are sorted and split into contiguous chains. Each chain trains its
+values in decreasing order, starting libsvm from the previous value's solution
+scaled down to the new C, which takes fewer iterations than starting from zero.
+Chains run in parallel when there are enough threads to give each one the five
+its probability folds can use. Results are in the order of Cs.
+
+The fold shuffles draw from rand(), so with parallel chains the Platt parameters,
+and with them the probabilities and accuracy, can vary slightly between runs. */
+vector<SweepResult> FastSK::sweep_C(const vector<double> &Cs, double nu, double eps, const string kernel_type) {
+    if (Cs.empty()) {
+        printf("Error: no C values to sweep\n");
+        exit(1);
+    }
+    if (this->n_str_test <= 0) {
+        printf("Error: a C sweep needs test sequences\n");
+        exit(1);
+    }
+    vector<size_t> order(Cs.size());
+    for (size_t v = 0; v < Cs.size(); v++) {
+        if (Cs[v] <= 0) {
+            printf("Error: C must be positive, got %g\n", Cs[v]);
+            exit(1);
+        }
+        order[v] = v;
+    }
+    stable_sort(order.begin(), order.end(), [&Cs](size_t a, size_t b) { return Cs[a] > Cs[b]; });
+
+    this->C = Cs[order[0]];
+    this->nu = nu;
+    this->eps = eps;
+    this->set_kernel_type(kernel_type);
     int n_str_train = this->n_str_train;
-    struct svm_problem* prob = Malloc(svm_problem, 1);
-    const char* error_msg;
+    int n_str_test = this->n_str_test;
 
-    svm_node** x;
-    svm_node* x_space;
-    prob->l = n_str_train;
-    prob->y = Malloc(double, prob->l);
-    x = Malloc(svm_node*, prob->l);
-    if (svm_param->kernel_type == FASTSK) {
-        x_space = Malloc(struct svm_node, (n_str_train + 1) * n_str_train);
-        int totalind = 0;
-        for (int i = 0; i < n_str_train; i++) {
-            x[i] = &x_space[totalind];
-            for (int j = 0; j < n_str_train; j++) {
-                x_space[j + i * (n_str_train + 1)].index = j + 1;
-                x_space[j + i * (n_str_train + 1)].value = tri_access(K, i, j);
+    struct svm_parameter* base_param = this->create_svm_parameter();
+    set<int> classes(this->train_labels, this->train_labels + n_str_train);
+    double *gram = this->second_level_kernel(base_param, classes.size(), NULL);
+    double gamma = base_param->gamma;
+    svm_problem *prob = this->create_svm_problem((gram != NULL) ? gram : this->K, this->train_labels, base_param);
+    float *K_float = this->single_precision_kernel(base_param);
+    double *test_K = construct_test_kernel(n_str_train, n_str_test, this->K);
+    if (this->quiet) {
+        svm_set_print_string_function(&print_null);
+    }
+
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    int num_chains = max(1, min((int) Cs.size(), num_threads / 5));
+    int chain_threads = max(1, num_threads / num_chains);
+    printf("Sweeping %d C values in %d chain(s)...\n", (int) Cs.size(), num_chains);
+
+    vector<SweepResult> results(Cs.size());
+    vector<thread> threads;
+    for (int c = 0; c < num_chains; c++) {
+        threads.push_back(thread([&, c]() {
+            size_t begin = c * order.size() / num_chains;
+            size_t end = (c + 1) * order.size() / num_chains;
+            svm_model *previous = NULL;
+            for (size_t r = begin; r < end; r++) {
+                size_t v = order[r];
+                struct svm_parameter* svm_param = Malloc(svm_parameter, 1);
+                *svm_param = *base_param;
+                svm_param->C = Cs[v];
+                svm_param->nr_thread = chain_threads;
+
+                svm_model *model = this->train_model(prob, svm_param, previous);
+                DenseModel dense = build_dense_model(model, this->kernel_type, gamma, this->K, n_str_train);
+                MetricsAccumulator metrics;
+                this->predict_rows(model, dense, chain_threads, test_K, n_str_test, this->test_labels, metrics, NULL);
+
+                results[v].C = Cs[v];
+                results[v].num_sv = model->l;
+                results[v].auroc = metrics.auroc();
+                results[v].auprc = metrics.auprc();
+                results[v].accuracy = metrics.accuracy();
+                if (previous != NULL) {
+                    svm_free_and_destroy_model(&previous);
+                }
+                previous = model;
             }
-            totalind += n_str_train;
-            x_space[totalind].index = -1;
-            totalind++;
-            prob->y[i] = labels[i];
+            if (previous != NULL) {
+                svm_free_and_destroy_model(&previous);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    free(test_K);
+    free_svm_problem(prob);
+    free(base_param);
+    free(gram);
+    free(K_float);
+    return results;
+}
+
+// Write the results of sweep_C as a tab separated table, one line per C value
+void write_sweep(const vector<SweepResult> &results, const string outfile) {
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        printf("Error: could not open sweep output file %s\n", outfile.c_str());
+        exit(1);
+    }
+    fprintf(out, "C\tnum_sv\tauroc\tauprc\taccuracy\n");
+    for (const SweepResult &result : results) {
+        fprintf(out, "%g\t%d\t%f\t%f\t%f\n", result.C, result.num_sv, result.auroc, result.auprc, result.accuracy);
+    }
+    fclose(out);
+    printf("Wrote the C sweep to %s\n", outfile.c_str());
+}
+
+// Free the models and problems of fit_tasks
+void FastSK::free_tasks() {
+    for (size_t t = 0; t < this->task_models.size(); t++) {
+        svm_free_and_destroy_model(&this->task_models[t]);
+    }
+    // only the first problem owns the nodes
+    for (size_t t = 1; t < this->task_problems.size(); t++) {
+        free(this->task_problems[t]->y);
+        free(this->task_problems[t]);
+    }
+    if (!this->task_problems.empty()) {
+        free_svm_problem(this->task_problems[0]);
+    }
+    this->task_names.clear();
+    this->task_models.clear();
+    this->task_problems.clear();
+    this->task_dense_models.clear();
+}
+
+/* Train one model per label column of labels, all on the training kernel computed
+once. The tasks only differ in their labels, so their problems share the svm_node
+storage (and, for the linear and rbf kernels, the second level kernel). Tasks are
+trained in parallel when there are enough threads to give each training the five
+its probability folds can use; with parallel tasks the fold shuffles draw from
+rand() in no fixed order, so the Platt parameters can vary slightly between runs. */
+void FastSK::fit_tasks(const TaskLabels &labels, double C, double nu, double eps, const string kernel_type) {
+    int n_str_train = this->n_str_train;
+    int num_tasks = labels.names.size();
+    if (num_tasks == 0) {
+        printf("Error: no tasks to train\n");
+        exit(1);
+    }
+    int num_classes = 0;
+    for (int t = 0; t < num_tasks; t++) {
+        if ((long) labels.labels[t].size() != n_str_train) {
+            printf("Error: task %s has %zu labels for %d training sequences\n", labels.names[t].c_str(), labels.labels[t].size(), n_str_train);
+            exit(1);
         }
-        //this->x_space = x_space;
-    } else if (svm_param->kernel_type == LINEAR || svm_param->kernel_type == RBF) {
-        x_space = Malloc(struct svm_node, (n_str_train + 1) * n_str_train);
-        int totalind = 0;
+        set<int> classes(labels.labels[t].begin(), labels.labels[t].end());
+        num_classes = max(num_classes, (int) classes.size());
+    }
+
+    this->C = C;
+    this->nu = nu;
+    this->eps = eps;
+    this->set_kernel_type(kernel_type);
+    this->free_tasks();
+
+    struct svm_parameter* base_param = this->create_svm_parameter();
+    double *gram = this->second_level_kernel(base_param, num_classes, NULL);
+    double gamma = base_param->gamma;
+
+    this->task_names = labels.names;
+    this->task_problems.push_back(this->create_svm_problem((gram != NULL) ? gram : this->K, (int *) labels.labels[0].data(), base_param));
+    float *K_float = this->single_precision_kernel(base_param);
+    for (int t = 1; t < num_tasks; t++) {
+        svm_problem *prob = Malloc(svm_problem, 1);
+        prob->l = n_str_train;
+        prob->x = this->task_problems[0]->x;
+        prob->y = Malloc(double, n_str_train);
         for (int i = 0; i < n_str_train; i++) {
-            x[i] = &x_space[totalind];
-            for (int j = 0; j < n_str_train; j++) {
-                x_space[j + i * (n_str_train + 1)].index = j + 1;
-                x_space[j + i * (n_str_train + 1)].value = tri_access(K, i, j);
+            prob->y[i] = labels.labels[t][i];
+        }
+        const char *error_msg = svm_check_parameter(prob, base_param);
+        if (error_msg) {
+            std::cerr << "ERROR: task " << labels.names[t] << ": " << error_msg << std::endl;
+            exit(1);
+        }
+        this->task_problems.push_back(prob);
+    }
+    this->task_models.assign(num_tasks, NULL);
+    this->task_dense_models.resize(num_tasks);
+
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    int num_workers = max(1, min(num_tasks, num_threads / 5));
+    int worker_threads = max(1, num_threads / num_workers);
+    printf("Training %d tasks, %d at a time...\n", num_tasks, num_workers);
+
+    atomic<int> next_task(0);
+    vector<thread> threads;
+    for (int w = 0; w < num_workers; w++) {
+        threads.push_back(thread([&]() {
+            int t;
+            while ((t = next_task++) < num_tasks) {
+                struct svm_parameter* svm_param = Malloc(svm_parameter, 1);
+                *svm_param = *base_param;
+                svm_param->nr_thread = worker_threads;
+                this->task_models[t] = this->train_model(this->task_problems[t], svm_param, NULL);
+                this->task_dense_models[t] = build_dense_model(this->task_models[t], this->kernel_type, gamma, this->K, n_str_train);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    free(base_param);
+    free(gram);
+    free(K_float);
+}
+
+/* Score the test sequences of the one-shot kernel with every model of fit_tasks,
+building the test kernel block once. The predictions of each task go to
+outprefix followed by the task name. labels holds the test labels of each task;
+if it is NULL the labels of the test FASTA file are used for all of them. */
+vector<TaskResult> FastSK::score_tasks(const TaskLabels *labels, const string outprefix) {
+    int n_str_train = this->n_str_train;
+    int n_str_test = this->n_str_test;
+    int num_tasks = this->task_models.size();
+    if (n_str_test <= 0) {
+        printf("Error: scoring tasks needs test sequences\n");
+        exit(1);
+    }
+    if (labels != NULL) {
+        for (int t = 0; t < num_tasks; t++) {
+            if (t >= (int) labels->names.size() || labels->names[t] != this->task_names[t]
+                || (long) labels->labels[t].size() != n_str_test) {
+                printf("Error: the test labels must have the training tasks, in order, with a label per test sequence\n");
+                exit(1);
             }
-            totalind += n_str_train;
-            x_space[totalind].index = -1;
-            totalind++;
-            prob->y[i] = labels[i];
         }
-        //this->x_space = x_space;
     }
 
-    prob->x = x;
+    double *test_K = construct_test_kernel(n_str_train, n_str_test, this->K);
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    vector<TaskResult> results(num_tasks);
+    for (int t = 0; t < num_tasks; t++) {
+        const int *test_labels = (labels != NULL) ? labels->labels[t].data() : this->test_labels;
+        PredictionWriter *auc_file = this->open_predictions(outprefix + this->task_names[t] + ".txt");
+        MetricsAccumulator metrics;
+        this->predict_rows(this->task_models[t], this->task_dense_models[t], num_threads, test_K, n_str_test, test_labels, metrics, auc_file);
+        delete auc_file;
+
+        results[t].name = this->task_names[t];
+        results[t].num_sv = this->task_models[t]->l;
+        results[t].auroc = metrics.auroc();
+        results[t].auprc = metrics.auprc();
+        results[t].accuracy = metrics.accuracy();
+    }
+    free(test_K);
+    return results;
+}
 
-    // if quiet mode, set libsvm's print function to null
+// Write the results of score_tasks as a tab separated table, one line per task
+void write_tasks(const vector<TaskResult> &results, const string outfile) {
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        printf("Error: could not open task output file %s\n", outfile.c_str());
+        exit(1);
+    }
+    fprintf(out, "task\tnum_sv\tauroc\tauprc\taccuracy\n");
+    for (const TaskResult &result : results) {
+        fprintf(out, "%s\t%d\t%f\t%f\t%f\n", result.name.c_str(), result.num_sv, result.auroc, result.auprc, result.accuracy);
+    }
+    fclose(out);
+    printf("Wrote the task results to %s\n", outfile.c_str());
+}
+
+/* Stratified nfold cross validation on the training kernel. The kernel is not
+copied: libsvm trains on the fastsk kernel (or the second level one) through
+id nodes, so each fold's training problem is a list of pointers to the nodes of
+the full problem, and the held out sequences are scored by their kernel values
+against its support vectors. Folds are trained in parallel, splitting the threads
+between them. Each class is shuffled with rand() and dealt to the folds in turn.
+The held out sequences are scored by decision value, oriented so that positive
+means label 1, so the folds skip libsvm's probability estimates. Returns the
+metrics of each fold followed by those of all held out predictions pooled, which
+has fold 0. */
+vector<FoldResult> FastSK::cross_validate(int nfold, double C, double nu, double eps, const string kernel_type) {
+    int n_str_train = this->n_str_train;
+    int *labels = this->train_labels;
+    if (set<int>(labels, labels + n_str_train).size() != 2) {
+        printf("Error: cross validation needs training labels of two classes\n");
+        exit(1);
+    }
+    vector<vector<int> > classes(2);
+    for (int i = 0; i < n_str_train; i++) {
+        classes[labels[i] == 1 ? 0 : 1].push_back(i);
+    }
+    if (nfold < 2) {
+        printf("Error: cross validation needs at least 2 folds, got %d\n", nfold);
+        exit(1);
+    }
+    if ((int) classes[0].size() < nfold || (int) classes[1].size() < nfold) {
+        printf("Error: %d fold cross validation needs at least %d positive and %d negative training sequences\n", nfold, nfold, nfold);
+        exit(1);
+    }
+
+    this->C = C;
+    this->nu = nu;
+    this->eps = eps;
+    this->set_kernel_type(kernel_type);
+
+    struct svm_parameter* base_param = this->create_svm_parameter();
+    base_param->probability = 0;
+    // the linear and rbf feature vectors of a fold only hold the kernel columns of
+    // its training sequences, as those of test sequences do for a model trained on
+    // them all, so every fold trains on a second level kernel of its own
+    bool second_level = (this->kernel_type != FASTSK);
+    if (second_level) {
+        base_param->kernel_type = FASTSK;
+    }
+    svm_problem *prob = this->create_svm_problem(this->K, labels, base_param);
+    float *K_float = second_level ? NULL : this->single_precision_kernel(base_param);
     if (this->quiet) {
         svm_set_print_string_function(&print_null);
     }
 
-    error_msg = svm_check_parameter(prob, svm_param);
+    vector<int> fold_of(n_str_train);
+    for (vector<int> &members : classes) {
+        for (size_t r = 0; r < members.size(); r++) {
+            swap(members[r], members[r + rand() % (members.size() - r)]);
+            fold_of[members[r]] = r % nfold;
+        }
+    }
 
-    if (error_msg) {
-        std::cerr << "ERROR: " << error_msg << std::endl;
+    // a second level kernel is as large as K, so those folds are trained one at a
+    // time, each with all the threads
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    int num_workers = second_level ? 1 : max(1, min(nfold, num_threads));
+    int worker_threads = max(1, num_threads / num_workers);
+    printf("Cross validating %d folds, %d at a time...\n", nfold, num_workers);
+
+    vector<double> scores(n_str_train);
+    vector<FoldResult> results(nfold + 1);
+    atomic<int> next_fold(0);
+    vector<thread> threads;
+    for (int w = 0; w < num_workers; w++) {
+        threads.push_back(thread([&]() {
+            int f;
+            while ((f = next_fold++) < nfold) {
+                svm_problem sub;
+                sub.l = 0;
+                sub.x = Malloc(svm_node *, n_str_train);
+                sub.y = Malloc(double, n_str_train);
+                vector<int> held_out;
+                for (int i = 0; i < n_str_train; i++) {
+                    if (fold_of[i] == f) {
+                        held_out.push_back(i);
+                    } else {
+                        sub.x[sub.l] = prob->x[i];
+                        sub.y[sub.l] = prob->y[i];
+                        sub.l++;
+                    }
+                }
+
+                struct svm_parameter* svm_param = Malloc(svm_parameter, 1);
+                *svm_param = *base_param;
+                svm_param->nr_thread = worker_threads;
+                double *gram = NULL;
+                float *gram_float = NULL;
+                if (second_level) {
+                    vector<char> in_training(n_str_train);
+                    for (int i = 0; i < n_str_train; i++) {
+                        in_training[i] = (fold_of[i] != f);
+                    }
+                    gram = this->second_level_kernel(svm_param, 2, in_training.data());
+                    svm_param->kernel_matrix = gram;
+                    gram_float = this->single_precision_kernel(svm_param);
+                }
+                svm_model *model = this->train_model(&sub, svm_param, NULL);
+                double sign = (model->label[0] == 1) ? 1 : -1;
+
+                MetricsAccumulator metrics;
+                for (int i : held_out) {
+                    double dec;
+                    svm_predict_values(model, prob->x[i], &dec);
+                    scores[i] = sign * dec;
+                    metrics.add(labels[i], (scores[i] > 0) ? 1 : -1, scores[i]);
+                }
+
+                results[f].fold = f + 1;
+                results[f].num_train = sub.l;
+                results[f].num_test = held_out.size();
+                results[f].num_sv = model->l;
+                results[f].auroc = metrics.auroc();
+                results[f].auprc = metrics.auprc();
+                results[f].accuracy = metrics.accuracy();
+                svm_free_and_destroy_model(&model);
+                free(gram);
+                free(gram_float);
+                free(sub.x);
+                free(sub.y);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    MetricsAccumulator pooled;
+    for (int i = 0; i < n_str_train; i++) {
+        pooled.add(labels[i], (scores[i] > 0) ? 1 : -1, scores[i]);
+    }
+    results[nfold].fold = 0;
+    results[nfold].num_train = n_str_train;
+    results[nfold].num_test = n_str_train;
+    results[nfold].num_sv = 0;
+    results[nfold].auroc = pooled.auroc();
+    results[nfold].auprc = pooled.auprc();
+    results[nfold].accuracy = pooled.accuracy();
+    for (int f = 0; f < nfold; f++) {
+        printf("Fold %d: AUROC %f\n", f + 1, results[f].auroc);
+    }
+    printf("Pooled AUROC: %f\n", pooled.auroc());
+
+    free_svm_problem(prob);
+    free(base_param);
+    free(K_float);
+    return results;
+}
+
+// Write the results of cross_validate as a tab separated table, the pooled line last
+void write_folds(const vector<FoldResult> &results, const string outfile) {
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        printf("Error: could not open cross validation output file %s\n", outfile.c_str());
         exit(1);
     }
+    fprintf(out, "fold\tnum_train\tnum_test\tnum_sv\tauroc\tauprc\taccuracy\n");
+    for (const FoldResult &result : results) {
+        string fold = (result.fold == 0) ? "pooled" : to_string(result.fold);
+        fprintf(out, "%s\t%d\t%d\t%d\t%f\t%f\t%f\n", fold.c_str(), result.num_train, result.num_test, result.num_sv, result.auroc, result.auprc, result.accuracy);
+    }
+    fclose(out);
+    printf("Wrote the cross validation results to %s\n", outfile.c_str());
+}
+
+/* Write the trained model as a binary bundle (see model_bundle.hpp) that scores
+test sequences without the training file: the kernel settings, the dictionary, and
+the dense model over the training sequences it needs, which for the fastsk kernel
+are only those with a nonzero weight, i.e. the support vectors. Needs a two class
+model, as the bundle holds the dense form. */
+void FastSK::save_model(const string outfile) {
+    const DenseModel &dense = this->dense_model;
+    if (this->model == NULL || !dense.available) {
+        printf("Error: only a trained two class model can be saved\n");
+        exit(1);
+    }
+    if ((long) this->Xtrain.size() != this->n_str_train || this->dictmap.empty()) {
+        printf("Error: the training sequences of the model are not available to save\n");
+        exit(1);
+    }
+
+    SequenceSet seqs;
+    DenseModel kept = dense;
+    if (dense.kernel_type == RBF) {
+        seqs = this->Xtrain;
+    } else {
+        kept.w.clear();
+        for (int j = 0; j < this->n_str_train; j++) {
+            if (dense.w[j] != 0) {
+                seqs.push_back(this->Xtrain, j);
+                kept.w.push_back(dense.w[j]);
+            }
+        }
+        kept.n_train = kept.w.size();
+    }
+
+    ModelHeader header;
+    memset(&header, 0, sizeof(header));
+    header.g = this->g;
+    header.m = this->m;
+    header.approx = this->approx;
+    header.max_iters = this->max_iters;
+    header.skip_variance = this->skip_variance;
+    header.delta = this->delta;
+    write_model_bundle(outfile, header, this->dictmap, seqs, kept);
+}
+
+/* Replace the model, the kernel settings given to the constructor and the training
+sequences with those of a bundle written by save_model, so that score_stream can
+score test sequences without any training. The training kernel is not needed, only
+the kernel rows of test sequences against the bundle's sequences. */
+void FastSK::load_model(const string infile) {
+    ModelBundle bundle(infile);
+    const ModelHeader *header = bundle.header;
+    this->g = header->g;
+    this->m = header->m;
+    this->k = header->g - header->m;
+    this->approx = header->approx != 0;
+    this->max_iters = header->max_iters;
+    this->skip_variance = header->skip_variance != 0;
+    this->delta = header->delta;
+    this->kernel_type = header->kernel_type;
+    this->dictmap = bundle.dictmap();
+    this->Xtrain = bundle.sequences();
+    this->n_str_train = this->Xtrain.size();
+    this->dense_model = bundle.dense_model();
+    if (this->model != NULL) {
+        svm_free_and_destroy_model(&this->model);
+    }
+    free_svm_problem(this->problem);
+    this->problem = NULL;
+    this->free_kernel();
+    printf("Loaded a model of %ld support sequences from %s\n", this->n_str_train, infile.c_str());
+}
+
+// Train on a problem built by create_svm_problem, warm started from init if it is
+// not NULL (see svm_train_warm). svm_param is freed.
+svm_model* FastSK::train_model(svm_problem *prob, svm_parameter *svm_param, const svm_model *init) {
+    // if quiet mode, set libsvm's print function to null
+    if (this->quiet) {
+        svm_set_print_string_function(&print_null);
+    }
 
     // train that ish
     struct svm_model* model;
-    model = svm_train(prob, svm_param);
+    model = svm_train_warm(prob, svm_param, init);
+    // the single precision kernel only lives for training
+    model->param.kernel_matrix_float = NULL;
 
     free(svm_param);
 
     return model;
 }
 
+/* The training problem for libsvm. With the fastsk kernel type each sample is a
+single svm_node holding its id, and libsvm reads the kernel values from the packed
+triangular K itself (svm_parameter.kernel_matrix). Otherwise the kernel rows are
+the feature vectors, so those are expanded into svm_node rows. The support vectors
+of the model point into the problem, so it must outlive the model. */
 svm_problem* FastSK::create_svm_problem(double* K, int* labels, svm_parameter* svm_param) {
-    int n_str_train = this->n_str_train;
+    long n_str_train = this->n_str_train;
     struct svm_problem* prob = Malloc(svm_problem, 1);
     const char* error_msg;
     svm_node** x;
@@ -571,44 +1433,32 @@ svm_problem* FastSK::create_svm_problem(double* K, int* labels, svm_parameter* s
     x = Malloc(svm_node*, prob->l);
 
     if (svm_param->kernel_type == FASTSK) {
-        x_space = Malloc(struct svm_node, (n_str_train + 1) * n_str_train);
-        int totalind = 0;
-        for (int i = 0; i < n_str_train; i++) {
-            x[i] = &x_space[totalind];
-            for (int j = 0; j < n_str_train; j++) {
-                x_space[j + i * (n_str_train + 1)].index = j + 1;
-                x_space[j + i * (n_str_train + 1)].value = tri_access(K, i, j);
-            }
-            totalind += n_str_train;
-            x_space[totalind].index = -1;
-            totalind++;
+        svm_param->kernel_matrix = K;
+        x_space = Malloc(struct svm_node, 2 * n_str_train);
+        for (long i = 0; i < n_str_train; i++) {
+            x[i] = &x_space[2 * i];
+            x_space[2 * i].index = 0;
+            x_space[2 * i].value = i;
+            x_space[2 * i + 1].index = -1;
             prob->y[i] = labels[i];
         }
-        //this->x_space = x_space;
-    } else if (svm_param->kernel_type == LINEAR || svm_param->kernel_type == RBF) {
+    } else {
+        svm_param->kernel_matrix = NULL;
         x_space = Malloc(struct svm_node, (n_str_train + 1) * n_str_train);
-        int totalind = 0;
-        for (int i = 0; i < n_str_train; i++) {
-            x[i] = &x_space[totalind];
-            // seems like tri_access on K is causing the segfault
-            for (int j = 0; j < n_str_train; j++) {
-                x_space[j + i * (n_str_train + 1)].index = j + 1;
-                x_space[j + i * (n_str_train + 1)].value = tri_access(K, i, j);
+        for (long i = 0; i < n_str_train; i++) {
+            svm_node *row = &x_space[i * (n_str_train + 1)];
+            x[i] = row;
+            for (long j = 0; j < n_str_train; j++) {
+                row[j].index = j + 1;
+                row[j].value = tri_access(K, i, j);
             }
-            totalind += n_str_train;
-            x_space[totalind].index = -1;
-            totalind++;
+            row[n_str_train].index = -1;
             prob->y[i] = labels[i];
         }
-        //this->x_space = x_space;
     }
 
     prob->x = x;
 
-    if (this->quiet) {
-        svm_set_print_string_function(&print_null);
-    }
-
     error_msg = svm_check_parameter(prob, svm_param);
 
     if (error_msg) {
@@ -623,222 +1473,387 @@ double FastSK::score(const string metric, const string outfile="auc_file.txt") {
     if (metric != "accuracy" && metric != "auc") {
         throw std::invalid_argument("metric argument must be 'accuracy' or 'auc'");
     }
-    int n_str = this->total_str;
     int n_str_train = this->n_str_train;
     int n_str_test = this->n_str_test;
-    printf("Predicting labels for %d sequences...\n", n_str_test);
     double *test_K = construct_test_kernel(n_str_train, n_str_test, this->K);
-    int *test_labels = this->test_labels;
     printf("Test kernel constructed...\n");
 
-    int num_sv = this->model->nSV[0] + this->model->nSV[1];
-    printf("num_sv = %d\n", num_sv);
-    struct svm_node *x = Malloc(struct svm_node, n_str_train + 1);
-    int correct = 0;
-    // aggregators for finding num of pos and neg samples for auc
-    int pagg = 0, nagg = 0;
-    double* neg = Malloc(double, n_str_test);
-    double* pos = Malloc(double, n_str_test);
-
-    int fp = 0, fn = 0; //counters for false postives and negatives
-    int tp = 0, tn = 0; //counters for true postives and negatives
-    int labelind = 0;
-    for (int i =0; i < 2; i++){
-        if (this->model->label[i] == 1)
-            labelind = i;
-    }
-
-    FILE *auc_file;
-    auc_file = fopen(outfile.c_str(), "w+");
-
-    int svcount = 0;
-    for (int i = 0; i < n_str_test; i++) {
-        if (this->kernel_type == FASTSK) {
-            for (int j = 0; j < n_str_train; j++){
-                x[j].index = j + 1;
-                x[j].value = 0;
-            }
-            svcount = 0;
-            for (int j = 0; j < n_str_train; j++){
-                if (j == this->model->sv_indices[svcount] - 1){
-                    x[j].value = test_K[i * num_sv + svcount];
-                    svcount++;
-                }
-            }
-            x[n_str_train].index = -1;
-        } else if (this->kernel_type == LINEAR || this->kernel_type == RBF) {
-            for (int j = 0; j < n_str_train; j++){
-                x[j].index = j + 1;
-                x[j].value = test_K[i * n_str_train + j];
-            }
-            x[n_str_train].index = -1;
-        }
+    PredictionWriter *auc_file = this->open_predictions(outfile);
+    MetricsAccumulator metrics;
+    this->predict_rows(test_K, n_str_test, this->test_labels, metrics, *auc_file);
+    delete auc_file;
+    free(test_K);
 
-        // probs = [prob_pos, prob_neg], not [prob_neg, prob_pos]
-        double probs[2];
-        double guess = svm_predict_probability(this->model, x, probs);
-        fprintf(auc_file, "%d,%f\n", test_labels[i], probs[0]);
+    return this->report(metrics, metric);
+}
 
-        if (test_labels[i] > 0) {
-            pos[pagg] = probs[labelind];
-            pagg += 1;
-            if (guess < 0) {
-                fn++;
-            } else {
-                tp++;
-            }
-        } else {
-            neg[nagg] = probs[labelind];
-            nagg += 1;
-            if (guess > 0) {
-                fp++;
-            } else {
-                tn++;
-            }
-        }
+double FastSK::predict(const string metric) {
+    PredictionWriter *auc_file = this->open_predictions("auc_pred_file.txt");
+    MetricsAccumulator metrics;
+    this->predict_batch(this->K, this->n_str_test, this->test_labels, metrics, *auc_file);
+    delete auc_file;
 
-        //printf("guess = %f and test_labels[%d] = %d\n", guess, i, test_labels[i]);
-        if ((guess < 0.0 && test_labels[i] < 0) || (guess > 0.0 && test_labels[i] > 0)) {
-            correct++;
-        }
-    }
+    return this->report(metrics, metric);
+}
 
-    fclose(auc_file);
+// Predict a batch of test sequences from their dense n_str_test x n_str_train kernel
+// block K, which is freed afterwards
+void FastSK::predict_batch(double *K, int n_str_test, int *test_labels, MetricsAccumulator &metrics, PredictionWriter &auc_file) {
+    this->predict_rows(K, n_str_test, test_labels, metrics, auc_file);
+    free(K);
+}
 
-    if (pagg == 0 && metric == "auc") {
+// Print the accumulated metrics and return the requested one
+double FastSK::report(const MetricsAccumulator &metrics, const string metric) {
+    if (metrics.num_pos() == 0 && metric == "auc") {
         printf("No positive examples were in the test set. AUROC is undefined in this case.\n");
     }
-
-    double tpr = tp / (double) pagg;
-    double tnr = tn / (double) nagg;
-    double fnr = fn / (double) pagg;
-    double fpr = fp / (double) nagg;
-    double auc = calculate_auc(pos, neg, pagg, nagg);
-    double acc = 100 * correct / (double)  n_str_test;
-    if (!this->quiet) {
-        printf("Num sequences: %d\n", nagg + pagg);
-        printf("Num positive: %d, Num negative: %d\n", pagg, nagg);
-        printf("TPR: %f\n", tpr);
-        printf("TNR: %f\n", tnr);
-        printf("FNR: %f\n", fnr);
-        printf("FPR: %f\n", fpr);
-    }
-    printf("\nAccuracy: %f\n", acc);
-    printf("AUROC: %f\n", auc);
+    metrics.print(this->quiet);
 
     if (metric == "auc") {
-        return auc;
+        return metrics.auroc();
     }
+    return metrics.accuracy();
+}
 
-    return acc;
+// Result of predicting one test sequence
+typedef struct RowPrediction {
+    double guess;                   // predicted label
+    double prob_first;              // probability of model->label[0], which is what gets written
+    double prob_pos;                // probability of label 1, used for AUROC
+} RowPrediction;
+
+/* Predict every row of the dense n_str_test x n_str_train test kernel block K,
+appending the predictions to auc_file and to metrics. Rows are split into chunks
+that the threads claim in turn. For two-class models a chunk's decision values
+come from the dense model (one matrix-vector product for the fastsk and linear
+kernels); otherwise each row goes through libsvm, each thread reusing its own
+svm_node buffer.
+Finished chunks go through a reorder buffer so predictions are recorded in input
+order, exactly as a single thread would. */
+void FastSK::predict_rows(const double *K, int n_str_test, const int *test_labels, MetricsAccumulator &metrics, PredictionWriter &auc_file) {
+    int num_threads = (this->num_threads == -1) ? 20 : this->num_threads;
+    this->predict_rows(this->model, this->dense_model, num_threads, K, n_str_test, test_labels, metrics, &auc_file);
 }
 
-double FastSK::predict(const string metric) {
+// predict_rows with the given model and number of threads. auc_file may be NULL.
+void FastSK::predict_rows(const svm_model *model, const DenseModel &dense, int num_threads, const double *K, int n_str_test, const int *test_labels, MetricsAccumulator &metrics, PredictionWriter *auc_file) {
     int n_str_train = this->n_str_train;
-    int n_str_test = this->n_str_test;
     printf("Predicting labels for %d sequences...\n", n_str_test);
-    int *test_labels = this->test_labels;
-
-    int num_sv = this->model->nSV[0] + this->model->nSV[1];
-    printf("num_sv = %d\n", num_sv);
-    struct svm_node *x = Malloc(struct svm_node, n_str_train + 1);
-    int correct = 0;
-    // aggregators for finding num of pos and neg samples for auc
-    int pagg = 0, nagg = 0;
-    double* neg = Malloc(double, n_str_test);
-    double* pos = Malloc(double, n_str_test);
-
-    int fp = 0, fn = 0; //counters for false postives and negatives
-    int tp = 0, tn = 0; //counters for true postives and negatives
+
+    // a model read by load_model only has its dense form
+    if (model != NULL) {
+        int num_sv = model->nSV[0] + model->nSV[1];
+        printf("num_sv = %d\n", num_sv);
+    }
+    const int *label = dense.available ? dense.label : model->label;
     int labelind = 0;
     for (int i =0; i < 2; i++){
-        if (this->model->label[i] == 1)
+        if (label[i] == 1)
             labelind = i;
     }
 
-    FILE *auc_file;
-    auc_file = fopen("auc_pred_file.txt", "w+");
+    const int chunk_size = 256;
+    int num_chunks = (n_str_test + chunk_size - 1) / chunk_size;
+    num_threads = max(1, min(num_threads, num_chunks));
 
-    int svcount = 0;
-    for (int i = 0; i < n_str_test; i++) {
-        if (this->kernel_type == FASTSK) {
-            for (int j = 0; j < n_str_train; j++){
-                x[j].index = j + 1;
-                x[j].value = 0;
+    ReorderBuffer<pair<int, vector<RowPrediction> > > reorder([&](pair<int, vector<RowPrediction> > &chunk) {
+        int offset = chunk.first * chunk_size;
+        for (size_t r = 0; r < chunk.second.size(); r++) {
+            int i = offset + r;
+            if (auc_file != NULL) {
+                auc_file->write(test_labels[i], chunk.second[r].prob_first);
             }
-            svcount = 0;
-            for (int j = 0; j < n_str_train; j++) {
-                x[j].value = this->K[i * n_str_train + j];
-                svcount++;
+            metrics.add(test_labels[i], chunk.second[r].guess, chunk.second[r].prob_pos);
+        }
+    });
+
+    std::atomic<int> next_chunk(0);
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+        threads.push_back(std::thread([&]() {
+            struct svm_node *x = NULL;
+            if (!dense.available) {
+                x = Malloc(struct svm_node, n_str_train + 1);
+                for (int j = 0; j < n_str_train; j++) {
+                    x[j].index = j + 1;
+                }
+                x[n_str_train].index = -1;
             }
-
-            x[n_str_train].index = -1;
-        } else if (this->kernel_type == LINEAR || this->kernel_type == RBF) {
-            for (int j = 0; j < n_str_train; j++){
-                x[j].index = j + 1;
-                x[j].value = this->K[i * n_str_train + j];
+            vector<double> dec(chunk_size);
+
+            int c;
+            while ((c = next_chunk++) < num_chunks) {
+                int start = c * chunk_size;
+                int end = min(n_str_test, start + chunk_size);
+                vector<RowPrediction> predictions(end - start);
+                if (dense.available) {
+                    dense_decision_values(dense, K + (long) start * n_str_train, end - start, dec.data());
+                    for (int i = start; i < end; i++) {
+                        double p = dense_probability(dense, dec[i - start]);
+                        predictions[i - start].guess = dense_label(dense, dec[i - start], p);
+                        predictions[i - start].prob_first = p;
+                        predictions[i - start].prob_pos = (labelind == 0) ? p : 1 - p;
+                    }
+                } else {
+                    for (int i = start; i < end; i++) {
+                        for (int j = 0; j < n_str_train; j++) {
+                            x[j].value = K[(long) i * n_str_train + j];
+                        }
+
+                        // probs = [prob_pos, prob_neg], not [prob_neg, prob_pos]
+                        double probs[2];
+                        predictions[i - start].guess = svm_predict_probability(model, x, probs);
+                        predictions[i - start].prob_first = probs[0];
+                        predictions[i - start].prob_pos = probs[labelind];
+                    }
+                }
+                reorder.put(c, make_pair(c, std::move(predictions)));
             }
-            x[n_str_train].index = -1;
+            free(x);
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+}
+
+// Weight of each training sequence in the decision function, i.e. the w such that
+// dec(x) = sum_j w[j] * K(x, train_j) - rho, oriented so that positive means label 1.
+// Only defined for the fastsk and linear kernels of the exact kernel function: the
+// g-mer weights built from them sum every mismatch profile, while the approximate
+// kernel only sums the sampled ones.
+vector<double> FastSK::sequence_weights() {
+    if (!this->dense_model.available || this->dense_model.kernel_type == RBF) {
+        printf("Error: per-sequence weights are only available for the 'linear' and 'fastsk' kernels\n");
+        exit(1);
+    }
+    if (this->approx) {
+        printf("Error: per-sequence weights are not available for the approximate kernel (-a)\n");
+        exit(1);
+    }
+
+    double sign = (this->dense_model.label[0] == 1) ? 1 : -1;
+    vector<double> w(this->dense_model.w);
+    for (size_t j = 0; j < w.size(); j++) {
+        w[j] *= sign;
+    }
+
+    return w;
+}
+
+/* In-silico saturation mutagenesis. For every position of every sequence in Xtest,
+and every symbol of the alphabet, writes the change in decision value caused by
+substituting that symbol. Only the (at most g) g-mers overlapping the mutated
+position are re-evaluated against the per g-mer weights of the trained model. */
+void FastSK::ism(const SequenceSet &Xtest, const map<char, int> &dictmap, const string outfile, bool binary) {
+    int g = this->g;
+
+    vector<char> alphabet = code_alphabet(dictmap);
+    int alphabet_size = alphabet.size() - 1;
+
+    printf("Building g-mer weights for ISM...\n");
+    GmerWeights gmer_weights(g, this->m, alphabet_size);
+    gmer_weights.build(this->Xtrain, this->sequence_weights(), this->num_threads);
+
+    FILE *out = fopen(outfile.c_str(), binary ? "wb" : "w");
+    if (out == NULL) {
+        printf("Error: could not open ISM output file %s\n", outfile.c_str());
+        exit(1);
+    }
+    int n_seq = Xtest.size();
+    if (binary) {
+        // header: magic, alphabet size, alphabet characters, number of sequences.
+        // each sequence follows as its length L and an L x alphabet_size float32 matrix
+        fwrite("FSKISM01", 1, 8, out);
+        fwrite(&alphabet_size, sizeof(int), 1, out);
+        fwrite(&alphabet[1], 1, alphabet_size, out);
+        fwrite(&n_seq, sizeof(int), 1, out);
+    } else {
+        fprintf(out, "seq\tpos\tref");
+        for (int c = 1; c <= alphabet_size; c++) {
+            fprintf(out, "\t%c", alphabet[c]);
         }
+        fprintf(out, "\n");
+    }
 
-        // probs = [prob_pos, prob_neg], not [prob_neg, prob_pos]
-        double probs[2];
-        double guess = svm_predict_probability(this->model, x, probs);
-        fprintf(auc_file, "%d,%f\n", test_labels[i], probs[0]);
+    int num_threads = (this->num_threads < 1) ? 1 : this->num_threads;
+    int block_size = 64 * num_threads;
+    vector<vector<float> > deltas(block_size);
+
+    printf("Scoring %d sequences with ISM using %d threads...\n", n_seq, num_threads);
+    for (int start = 0; start < n_seq; start += block_size) {
+        int end = min(n_seq, start + block_size);
+
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.push_back(std::thread([&, tid]() {
+                vector<double> base;
+                for (int s = start + tid; s < end; s += num_threads) {
+                    vector<uint8_t> seq(Xtest.data(s), Xtest.data(s) + Xtest.length(s));
+                    int len = seq.size();
+                    vector<float> &delta = deltas[s - start];
+                    delta.assign((size_t) len * alphabet_size, 0);
+                    if (len < g) continue;
+
+                    base.resize(len - g + 1);
+                    gmer_weights.position_weights(seq.data(), len, base.data());
+
+                    for (int i = 0; i < len; i++) {
+                        int ref = seq[i];
+                        int first = max(0, i - g + 1);
+                        int last = min(i, len - g);
+                        for (int c = 1; c <= alphabet_size; c++) {
+                            if (c == ref) continue;
+                            seq[i] = c;
+                            double d = 0;
+                            for (int p = first; p <= last; p++) {
+                                d += gmer_weights.gmer_weight(seq.data() + p) - base[p];
+                            }
+                            delta[(size_t) i * alphabet_size + c - 1] = d;
+                        }
+                        seq[i] = ref;
+                    }
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
 
-        if (test_labels[i] > 0) {
-            pos[pagg] = probs[labelind];
-            pagg += 1;
-            if (guess < 0) {
-                fn++;
-            } else {
-                tp++;
-            }
-        } else {
-            neg[nagg] = probs[labelind];
-            nagg += 1;
-            if (guess > 0) {
-                fp++;
+        // write in input order
+        for (int s = start; s < end; s++) {
+            const vector<float> &delta = deltas[s - start];
+            int len = Xtest.length(s);
+            if (binary) {
+                fwrite(&len, sizeof(int), 1, out);
+                fwrite(delta.data(), sizeof(float), delta.size(), out);
             } else {
-                tn++;
+                for (int i = 0; i < len; i++) {
+                    fprintf(out, "%d\t%d\t%c", s, i, alphabet[Xtest.data(s)[i]]);
+                    for (int c = 0; c < alphabet_size; c++) {
+                        fprintf(out, "\t%g", delta[(size_t) i * alphabet_size + c]);
+                    }
+                    fprintf(out, "\n");
+                }
             }
         }
-
-        //printf("guess = %f and test_labels[%d] = %d\n", guess, i, test_labels[i]);
-        if ((guess < 0.0 && test_labels[i] < 0) || (guess > 0.0 && test_labels[i] > 0)) {
-            correct++;
-        }
     }
 
-    fclose(auc_file);
+    fclose(out);
+    printf("Wrote ISM scores to %s\n", outfile.c_str());
+}
 
-    if (pagg == 0 && metric == "auc") {
-        printf("No positive examples were in the test set. AUROC is undefined in this case.\n");
+/* Sliding-window scan of long sequences, e.g. whole chromosomes, with a trained
+model. Every window of `window` bases, moved `stride` bases at a time, is scored
+with the decision value of the model. Adjacent windows share all but `stride`
+g-mers, so each thread keeps a rolling window score over its chunk of the
+chromosome and only adds the entering and subtracts the leaving g-mer weights.
+Writes one bedGraph-style line (chrom, start, end, score) per window. */
+void FastSK::scan(const string genome_file, const map<char, int> &dictmap, int window, int stride, const string outfile) {
+    int g = this->g;
+    if (window < g || stride < 1) {
+        printf("Error: the scan window must be at least g long and the stride at least 1\n");
+        exit(1);
     }
 
-    double tpr = tp / (double) pagg;
-    double tnr = tn / (double) nagg;
-    double fnr = fn / (double) pagg;
-    double fpr = fp / (double) nagg;
-    double auc = calculate_auc(pos, neg, pagg, nagg);
-    double acc = 100 * correct / (double)  n_str_test;
-    if (!this->quiet) {
-        printf("Num sequences: %d\n", nagg + pagg);
-        printf("Num positive: %d, Num negative: %d\n", pagg, nagg);
-        printf("TPR: %f\n", tpr);
-        printf("TNR: %f\n", tnr);
-        printf("FNR: %f\n", fnr);
-        printf("FPR: %f\n", fpr);
+    int alphabet_size = 0;
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        alphabet_size = max(alphabet_size, it->second);
+    }
+    int codes[256] = {0};
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        codes[(unsigned char) it->first] = it->second;
+        codes[(unsigned char) toupper(it->first)] = it->second;
     }
-    printf("\nAccuracy: %f\n", acc);
-    printf("AUROC: %f\n", auc);
 
-    free(this->K);
+    printf("Building g-mer weights for scanning...\n");
+    GmerWeights gmer_weights(g, this->m, alphabet_size);
+    gmer_weights.build(this->Xtrain, this->sequence_weights(), this->num_threads);
+    double bias = (this->model->label[0] == 1) ? this->model->rho[0] : -this->model->rho[0];
 
-    if (metric == "auc") {
-        return auc;
+    ifstream genome(genome_file);
+    if (genome.fail()) {
+        printf("Error: could not open genome file %s\n", genome_file.c_str());
+        exit(1);
     }
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        printf("Error: could not open scan output file %s\n", outfile.c_str());
+        exit(1);
+    }
+    fprintf(out, "track type=bedGraph name=fastsk_scan description=\"window=%d stride=%d\"\n", window, stride);
+
+    int num_threads = (this->num_threads < 1) ? 1 : this->num_threads;
+    long gmers_per_window = window - g + 1;
+    // windows are recomputed from scratch at the start of every block to bound memory and rounding drift
+    long block_windows = max(1L, (1L << 20) / stride);
+
+    string name, chrom;
+    while (read_fasta_record(genome, name, chrom)) {
+        long len = chrom.size();
+        if (len < window) {
+            printf("Skipping %s: shorter than the scan window\n", name.c_str());
+            continue;
+        }
+        long n_windows = (len - window) / stride + 1;
+        vector<double> scores(n_windows);
+        printf("Scanning %s: %ld bases, %ld windows using %d threads...\n", name.c_str(), len, n_windows, num_threads);
+
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.push_back(std::thread([&, tid]() {
+                long w_begin = n_windows * tid / num_threads;
+                long w_end = n_windows * (tid + 1) / num_threads;
+                vector<uint8_t> seq;
+                vector<double> weights;
+
+                for (long b = w_begin; b < w_end; b += block_windows) {
+                    long b_end = min(w_end, b + block_windows);
+                    long first = b * stride;
+                    long last = (b_end - 1) * stride + window;  // one past the last base needed
+
+                    seq.resize(last - first);
+                    for (long p = first; p < last; p++) {
+                        seq[p - first] = codes[(unsigned char) chrom[p]];
+                    }
+                    weights.resize(last - first - g + 1);
+                    gmer_weights.position_weights(seq.data(), seq.size(), weights.data());
+
+                    double score = 0;
+                    for (long p = 0; p < gmers_per_window; p++) {
+                        score += weights[p];
+                    }
+                    scores[b] = score - bias;
+
+                    for (long wi = b + 1; wi < b_end; wi++) {
+                        long start = (wi - 1) * stride - first;
+                        if (stride < gmers_per_window) {
+                            for (long p = start; p < start + stride; p++) {
+                                score -= weights[p];
+                                score += weights[p + gmers_per_window];
+                            }
+                        } else {
+                            score = 0;
+                            for (long p = start + stride; p < start + stride + gmers_per_window; p++) {
+                                score += weights[p];
+                            }
+                        }
+                        scores[wi] = score - bias;
+                    }
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
 
-    return acc;
-}
+        for (long wi = 0; wi < n_windows; wi++) {
+            fprintf(out, "%s\t%ld\t%ld\t%f\n", name.c_str(), wi * stride, wi * stride + window, scores[wi]);
+        }
+    }
 
+    fclose(out);
+    printf("Wrote window scores to %s\n", outfile.c_str());
+}
@@ -3,13 +3,58 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <stdio.h>
 #include "fastsk_kernel.hpp"
+#include "sequence_source.hpp"
+#include "dense_model.hpp"
+#include "metrics.hpp"
+#include "prediction_file.hpp"
+#include "kernel_file.hpp"
+#include "top_scores.hpp"
+#include "utils.hpp"
 #include "libsvm-code/svm.h"
 
 using namespace std;
 
 
 
+// A batch of test sequences travelling through the batch scoring pipeline
+typedef struct ScoreBatch {
+    SequenceSet seqs;
+    vector<int> labels;
+    double *K = NULL;               // n_batch x n_train kernel block, freed by prediction
+} ScoreBatch;
+
+// Result of training with one value of a C sweep and scoring the test sequences
+typedef struct SweepResult {
+    double C;
+    int num_sv;
+    double auroc;
+    double auprc;
+    double accuracy;
+} SweepResult;
+
+// Result of training one task of FastSK::fit_tasks and scoring the test sequences
+typedef struct TaskResult {
+    string name;
+    int num_sv;
+    double auroc;
+    double auprc;
+    double accuracy;
+} TaskResult;
+
+// Metrics of one fold of FastSK::cross_validate, or of all folds pooled (fold 0)
+typedef struct FoldResult {
+    int fold;
+    int num_train;
+    int num_test;
+    int num_sv;
+    double auroc;
+    double auprc;
+    double accuracy;
+} FoldResult;
+
 class FastSK {
     int g;
     int m;
@@ -36,39 +81,92 @@ class FastSK {
     int numClasses = -1;
     char *dictionary;
     bool quiet = false;
-    svm_model *model;
+    svm_model *model = NULL;
+    svm_problem *problem = NULL;    // training problem of model, which its support vectors point into
+    DenseModel dense_model;         // flattened copy of model for batched prediction
     int nfeat;
-    vector<vector<int> > Xtrain;
-    vector<vector<int> > Xtest;
+    SequenceSet Xtrain;
+    SequenceSet Xtest;
     int* train_labels;
     int* test_labels;
     double* K = NULL;
+    KernelFile *kernel_file = NULL; // mapping of a kernel read by load_kernel, which K points into
     bool approx = false;
     double delta = 0.025;
     int max_iters = -1;
     bool skip_variance = false;
     vector<double> stdevs;
+    double mem_budget = 0;          // bytes available to batch scoring, 0 for fixed size batches
+    bool binary_predictions = false;
+    bool prediction_labels = true;  // whether binary predictions include the labels
+    int top_k = 0;                  // batch scoring only keeps this many top and bottom sequences, if set
+    string top_k_file;
+    vector<char> alphabet;          // characters of the symbol codes, for writing sequences
+    vector<string> task_names;
+    vector<svm_problem *> task_problems;    // one per task of fit_tasks, all sharing the nodes of the first
+    vector<svm_model *> task_models;
+    vector<DenseModel> task_dense_models;
+    bool single_precision = false;  // whether libsvm trains on a float copy of the kernel
+    map<char, int> dictmap;         // symbol codes of the sequences, saved with the model
+
+    PredictionWriter *open_predictions(const string);
+    void set_kernel_type(const string);
+    svm_parameter* create_svm_parameter();
+    double* second_level_kernel(svm_parameter *, int, const char *);
+    float* single_precision_kernel(svm_parameter *);
+    void free_tasks();
+    void predict_rows(const svm_model *, const DenseModel &, int, const double *, int, const int *, MetricsAccumulator &, PredictionWriter *);
 
 public:
     FastSK(int, int, int, bool, double, int, bool);
-    void compute_kernel(vector<vector<int> >, vector<vector<int> >, int *, int *);
-    void compute_kernel(vector<vector<int> >, vector<vector<int> >);
+    void compute_kernel(const SequenceSet &, const SequenceSet &, int *, int *);
+    void compute_kernel(const SequenceSet &, const SequenceSet &);
     void compute_kernel(const string, const string, const string);
     void compute_kernel(const string, const string);
-    void compute_train(vector<vector<int> > Xtrain);
-    void compute_train(vector<vector<int> > Xtrain, int *);
-    void compute_kernel_batch(vector<vector<int> >, vector<vector<int>>);
+    void compute_train(const SequenceSet &);
+    void compute_train(const SequenceSet &, int *);
+    void compute_kernel_batch(const SequenceSet &, const SequenceSet &);
+    double* batch_kernel(const SequenceSet &, const SequenceSet &);
     vector<vector<double> > get_train_kernel();
     vector<vector<double> > get_test_kernel();
     vector<double> get_stdevs();
+    map<char, int> get_dictionary();
     void save_kernel(string);
+    void save_binary_kernel(const string);
+    void load_kernel(const string);
     void fit(double, double, double, const string);
-    svm_model* train_model(double *, int *, svm_parameter *);
+    vector<SweepResult> sweep_C(const vector<double> &, double, double, const string);
+    void fit_tasks(const TaskLabels &, double, double, double, const string);
+    vector<TaskResult> score_tasks(const TaskLabels *, const string);
+    vector<FoldResult> cross_validate(int, double, double, double, const string);
+    svm_model* train_model(svm_problem *, svm_parameter *, const svm_model *);
     svm_problem* create_svm_problem(double *, int *, svm_parameter *);
     double score(const string, const string);
     double predict(const string);
-    void batch_score(vector<vector<int> >, vector<vector<int >>, int*, int*, int, double, double, double, const string);
+    void predict_batch(double *, int, int *, MetricsAccumulator &, PredictionWriter &);
+    void predict_rows(const double *, int, const int *, MetricsAccumulator &, PredictionWriter &);
+    double report(const MetricsAccumulator &, const string);
+    void batch_score(const SequenceSet &, const SequenceSet &, int*, int*, int, double, double, double, const string);
+    void batch_score(const SequenceSet &, int*, SequenceSource &, int, double, double, double, const string);
+    void set_mem_budget(double);
+    void set_binary_predictions(bool, bool);
+    void set_single_precision(bool);
+    void set_dictionary(const map<char, int> &);
+    void save_model(const string);
+    void load_model(const string);
+    void score_stream(SequenceSource &, int);
+    void set_top_k(int, const string, const map<char, int> &);
+    void top_k_batch(double *, const SequenceSet &, long, TopScores &);
+    double batch_fixed_bytes();
+    double batch_seq_bytes(int);
+    vector<double> sequence_weights();
+    void ism(const SequenceSet &, const map<char, int> &, const string, bool);
+    void scan(const string, const map<char, int> &, int, int, const string);
     void free_kernel();
 };
 
+void write_sweep(const vector<SweepResult> &, const string);
+void write_tasks(const vector<TaskResult> &, const string);
+void write_folds(const vector<FoldResult> &, const string);
+
 #endif
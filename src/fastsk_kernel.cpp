@@ -106,29 +106,18 @@ double* KernelFunction::compute_kernel() {
     return K;
 }
 
+/* Kernel between a batch of test sequences and the training sequences, as a dense
+n_str_test x n_str_train matrix. Each thread owns a contiguous block of test rows
+and adds the matches of every mismatch profile straight into its rows of K, so no
+thread needs a private copy of the kernel and nothing has to be merged. The sorted
+training projections are shared by all threads: the profiles are processed in
+groups of num_threads, one projection being built per thread before every thread
+matches its rows against the whole group. */
 double* KernelFunction::compute_test_kernel() {
     kernel_params* params = this->params;
-
-    /* Build work queue - represents the partial kernel computations
-    that need to be completed by the threads */
+    BatchFeature *features = params->batch_features;
     int numCombinations = nchoosek(params->g, params->m);
-    
-    std::vector<int> indexes(numCombinations);
-    for (int i = 0; i < numCombinations; i++) {
-        indexes[i] = i;
-    }
-
-    auto rng = std::default_random_engine {};
-    rng.seed(std::time(0));
-    std::shuffle(std::begin(indexes), std::end(indexes), rng);
-
-    int queueSize = numCombinations;
-    WorkItem *workQueue = new WorkItem[queueSize];
-
-    for (int i = 0; i < numCombinations; i++) {
-        workQueue[i].m = params->m;
-        workQueue[i].combo_num = indexes[i];
-    }
+    long int n_str_test = params->n_str_test;
 
     /* Allocate gapped k-mer kernel */
     double *K = (double *) malloc(params->n_str_pairs * sizeof(double));
@@ -137,54 +126,63 @@ double* KernelFunction::compute_test_kernel() {
     /* Determine how many threads to use */
     int num_threads = params->num_threads;
     if (num_threads == -1) {
-        // returns number of processors
-        // int numCores = std::thread::hardware_concurrency();
-        // num_threads = (numCores > 20) ? 20 : numCores;
         num_threads = 20;
     }
-    num_threads = (num_threads > queueSize) ? queueSize : num_threads;
-
-    /* Create an array of mutex locks */
-    int num_mutex = params->num_mutex;
-    num_mutex = (num_mutex == -1 || num_mutex > num_threads) ? num_threads : num_mutex; 
-    pthread_mutex_t *mutexes = (pthread_mutex_t*) malloc(num_mutex * sizeof(pthread_mutex_t));
-    for (int i = 0; i < num_mutex; i++) {
-        pthread_mutex_init(&mutexes[i], NULL);
-    }
-
+    num_threads = (num_threads > n_str_test) ? n_str_test : num_threads;
+    num_threads = (num_threads < 1) ? 1 : num_threads;
     params->num_threads = num_threads;
-    params->num_mutex = num_mutex;
 
-    // If central theorem unlikely to apply, compute exact kernel
-    // if (numCombinations / num_threads < 50) {
-    //     params->approx = false;
-    // }
-    if (params->approx) {
-        printf("Computing approximate kernel...\n");
-    } else {
-        printf("Computing exact kernel...\n");
-    }
+    printf("Computing exact kernel...\n");
 
-    /* Multithreaded kernel construction */
-    if (!params->quiet) printf("Computing %d mismatch profiles using %d threads...\n", numCombinations, num_threads);
+    /* Split the test rows into one block per thread, and find the distinct test
+    g-mers occurring in each block. A g-mer's owners are sorted by row, so its
+    owners within a block are a contiguous range. */
+    std::vector<RowBlock> blocks(num_threads);
     std::vector<std::thread> threads;
     for (int tid = 0; tid < num_threads; tid++) {
-        threads.push_back(std::thread(&KernelFunction::test_kernel_build_parallel, this, tid, workQueue, queueSize, mutexes, params, K));
+        RowBlock *block = &blocks[tid];
+        block->row_start = n_str_test * tid / num_threads;
+        block->row_end = n_str_test * (tid + 1) / num_threads;
+        threads.push_back(std::thread([features, block]() {
+            for (int i = 0; i < features->n_test_feat; i++) {
+                int *first = features->test_groups + features->test_group_start[i];
+                int *last = features->test_groups + features->test_group_start[i + 1];
+                int *lo = std::lower_bound(first, last, (int) block->row_start);
+                int *hi = std::lower_bound(lo, last, (int) block->row_end);
+                if (lo != hi) {
+                    block->gmers.push_back(i);
+                    block->owner_start.push_back(lo - features->test_groups);
+                    block->owner_end.push_back(hi - features->test_groups);
+                }
+            }
+        }));
     }
-
     for (auto &t : threads) {
         t.join();
     }
+    threads.clear();
 
-    /* Kernel normalization */
-    // for (int i = 0; i < params->total_str; i++) {
-    //     for (int j = 0; j < i; j++) {
-    //         tri_access(K, i, j) = tri_access(K, i, j) / sqrt(tri_access(K, i, i) * tri_access(K, j, j));
-    //     }
-    // }
-    // for (int i = 0; i < params->total_str; i++) {
-    //     tri_access(K, i, i) = tri_access(K, i, i) / sqrt(tri_access(K, i, i) * tri_access(K, i, i));
-    // }
+    /* Multithreaded kernel construction */
+    if (!params->quiet) printf("Computing %d mismatch profiles using %d threads...\n", numCombinations, num_threads);
+    std::vector<TrainProjection> projections(num_threads);
+    for (int first = 0; first < numCombinations; first += num_threads) {
+        int n_group = std::min(num_threads, numCombinations - first);
+        for (int c = 0; c < n_group; c++) {
+            threads.push_back(std::thread(&KernelFunction::project_train, this, first + c, params, &projections[c]));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        threads.clear();
+
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.push_back(std::thread(&KernelFunction::test_kernel_rows, this, &blocks[tid], projections.data(), n_group, params, K));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        threads.clear();
+    }
 
     return K;
 }
@@ -279,7 +277,7 @@ void KernelFunction::kernel_build_parallel(int tid, WorkItem *workQueue, int que
 
         // specifies which partial kernel is to be computed
         int combo_num = workItem.combo_num;
-        Combinations *combinations = (Combinations *) malloc(sizeof(combinations));
+        Combinations *combinations = (Combinations *) malloc(sizeof(Combinations));
         (*combinations).n = g;
         (*combinations).k = k;
         (*combinations).num_comb = num_comb;
@@ -405,166 +403,76 @@ void KernelFunction::kernel_build_parallel(int tid, WorkItem *workQueue, int que
     }
 }
 
-void KernelFunction::test_kernel_build_parallel(int tid, WorkItem *workQueue, int queueSize,
-    pthread_mutex_t *mutexes, kernel_params *params, double *Ksfinal) {
-
-    int itemNum = tid;
+// Sort the training g-mers of one mismatch profile with the mismatch positions removed
+void KernelFunction::project_train(int combo_num, kernel_params *params, TrainProjection *projection) {
     BatchFeature *features = params->batch_features;
     std::string *train_features = (*features).train_features;
     int n_train_feat = (*features).n_train_feat;
     int *train_groups = (*features).train_groups;
-    std::string *test_features = (*features).test_features;
-    int n_test_feat = (*features).n_test_feat;
-    int *test_groups = (*features).test_groups;
     int g = params->g;
     int k = params->k;
-    int n_str_train = params->n_str_train;
-    long int n_str_pairs = params->n_str_pairs;
-    int num_mutex = params->num_mutex;
-    int num_threads = params->num_threads;
-    double delta = params->delta;
-    bool quiet = params->quiet;
-    bool approx = params->approx;
-    int max_iters = params->max_iters;
-    bool skip_variance = params->skip_variance;
-
-    int num_comb = nchoosek(g, k);
-
-    bool working = true;
-    int iter = 1;
 
     std::vector<int> positions;
     for (int i = 0; i < g; i++) {
         positions.push_back(i);
     }
+    projection->combination = getCombination(combo_num, positions, k);
 
-    unsigned int* Ks = (unsigned int*) malloc(sizeof(unsigned int) * n_str_pairs);
-    memset(Ks, 0, sizeof(unsigned int) * n_str_pairs);
+    std::vector<std::pair<std::string, int> > train_feat1(n_train_feat);
+    for (int i = 0; i < n_train_feat; i++) {
+        std::string removed_mismatch;
+        for (int j = 0; j < k; j++) {
+            removed_mismatch += train_features[i][projection->combination[j]];
+        }
+        train_feat1[i] = std::make_pair(removed_mismatch, train_groups[i]);
+    }
+    std::sort(train_feat1.begin(), train_feat1.end());
 
-    while (working) {
-        WorkItem workItem = workQueue[itemNum];
+    projection->keys.resize(n_train_feat);
+    projection->groups.resize(n_train_feat);
+    for (int i = 0; i < n_train_feat; i++) {
+        projection->keys[i].swap(train_feat1[i].first);
+        projection->groups[i] = train_feat1[i].second;
+    }
+}
 
-        // specifies which partial kernel is to be computed
-        int combo_num = workItem.combo_num;
-        Combinations *combinations = (Combinations *) malloc(sizeof(combinations));
-        (*combinations).n = g;
-        (*combinations).k = k;
-        (*combinations).num_comb = num_comb;
+// Add the matches of a group of mismatch profiles to the test rows owned by a block
+void KernelFunction::test_kernel_rows(RowBlock *block, TrainProjection *projections, int n_group,
+    kernel_params *params, double *K) {
 
-        std::vector<int> combination = getCombination(combo_num, positions, k);
+    BatchFeature *features = params->batch_features;
+    std::string *test_features = (*features).test_features;
+    int *test_groups = (*features).test_groups;
+    int k = params->k;
+    long int n_str_train = params->n_str_train;
 
-        std::string *train_feat2 = new std::string[n_train_feat];
-        for (int i = 0; i < n_train_feat; i++) {
-            std::string removed_mismatch;
-            for (int j = 0; j < k; j++) {
-                removed_mismatch += train_features[i][combination[j]];
-            }
-            train_feat2[i] = removed_mismatch;
-        }
+    for (int c = 0; c < n_group; c++) {
+        const std::vector<std::string> &keys = projections[c].keys;
+        const std::vector<int> &groups = projections[c].groups;
+        const std::vector<int> &combination = projections[c].combination;
 
-        std::string *test_feat1 = new std::string[n_test_feat];
-        for (int i = 0; i < n_test_feat; i++) {
-            std::string removed_mismatch;
+        // each distinct test g-mer is searched once, then credited to every test row it occurs in
+        std::string removed_mismatch(k, ' ');
+        for (size_t i = 0; i < block->gmers.size(); i++) {
+            const std::string &gmer = test_features[block->gmers[i]];
             for (int j = 0; j < k; j++) {
-                removed_mismatch += test_features[i][combination[j]];
+                removed_mismatch[j] = gmer[combination[j]];
             }
-            test_feat1[i] = removed_mismatch;
-        }
 
-        // std::unordered_map<std::string, std::vector<int>> test_feat1;
-        // for (int i = 0; i < n_test_feat; i++) {
-        //     std::string removed_mismatch;
-        //     for (int j = 0; j < k; j++) {
-        //         removed_mismatch += test_features[i][combination[j]];
-        //     }
-        //     auto it = test_feat1.find(removed_mismatch);
-        //     if (it != test_feat1.end()) {
-        //         it->second.push_back(test_groups[i]);
-        //     } else {
-        //         std::vector<int> groups;
-        //         groups.push_back(test_groups[i]);
-        //         test_feat1[removed_mismatch] = groups;
-        //     }
-        // }
-
-        
-        // Sort the features with mismatched positions removed
-        // and their groups    
-        std::vector<int> sortIdx(n_train_feat);
-        std::iota(sortIdx.begin(), sortIdx.end(), 0);
-
-        std::sort(sortIdx.begin(), sortIdx.end(), 
-            [&train_feat2](int left, int right) { return train_feat2[left] < train_feat2[right];});
-
-        int* train_groups_sort = (int *) malloc(n_train_feat * sizeof(int));
-        std::string *train_feat1 = new std::string[n_train_feat];
-        for (int i = 0; i < n_train_feat; i++) {
-            train_groups_sort[i] = train_groups[sortIdx[i]];
-            train_feat1[i] = train_feat2[sortIdx[i]];
-        }
-        
-        delete[] train_feat2;
-        std::sort(train_feat1, train_feat1 + n_train_feat);
-
-        for (int i = 0; i < n_test_feat; i++) {
-            auto start = lower_bound(train_feat1, train_feat1 + n_train_feat, test_feat1[i]);
-            while ((start - train_feat1) < n_train_feat && *start == test_feat1[i]) {
-                Ks[test_groups[i] * n_str_train + train_groups_sort[start - train_feat1]] += 1;
-                start++;
+            auto start = std::lower_bound(keys.begin(), keys.end(), removed_mismatch);
+            auto end = start;
+            while (end != keys.end() && *end == removed_mismatch) {
+                end++;
             }
-        }
-
-        delete[] train_feat1;
-        delete[] test_feat1;
-        free(train_groups_sort);
-        free(combinations);
-
-        // Check if the thread needs to handle more mismatch profiles
-        itemNum += num_threads;
-        if (itemNum >= queueSize) {
-            working = false;
-        }
-
-        iter++;
-    }
-
-    printf("Thread %d finished in %d iterations...\n", tid, iter - 1);
-
-    // set up the mutexes to lock as you go through the matrix
-    int cusps[num_mutex];
-    for (int i = 0; i < num_mutex; i++) {
-        cusps[i] = (int) (i * ((double) n_str_pairs) / num_mutex);
-    }
-
-    /* the feared kernel update step, locking is necessary to keep it thread-safe.
-    current locking strategy involves splitting the array rows into groups and locking per group.
-    also tried going top->bottom or bottom->top dependent on work order to split
-    contention among the locks, seemed to split up contention but made it slightly slower?
-    */
-    int count = 0;
-    if (num_threads > 1) {
-        for (int j1 = 0; j1 < n_str_pairs; ++j1) {
-            if (j1 == cusps[count]) {
-                if (count != 0) {
-                    pthread_mutex_unlock(&mutexes[count - 1]);
+            if (start == end) continue;
+            for (int o = block->owner_start[i]; o < block->owner_end[i]; o++) {
+                double *row = K + test_groups[o] * n_str_train;
+                for (auto it = start; it != end; it++) {
+                    row[groups[it - keys.begin()]] += 1;
                 }
-                pthread_mutex_lock(&mutexes[count]);
-                if (count + 1 < num_mutex) count++;
             }
-            //double val = (approx && !skip_variance) ? K_hat[j1] : Ks[j1];
-            double val = Ks[j1];
-            if (val != 0) Ksfinal[j1] += val;
-        }
-        pthread_mutex_unlock(&mutexes[num_mutex - 1]);
-    } else {
-        for (int i = 0; i < n_str_pairs; i++) {
-            //double val = (approx && !skip_variance) ? K_hat[i] : Ks[i];
-            double val = Ks[i];
-            if (val != 0) Ksfinal[i] += val;
         }
     }
-
-    free(Ks);
 }
 
 double *construct_test_kernel(int n_str_train, int n_str_test, double *K) {
@@ -3,6 +3,8 @@
 
 #include "shared.h"
 #include <thread>
+#include <vector>
+#include <string>
 
 typedef struct kernel_params {
     int g;
@@ -26,6 +28,23 @@ typedef struct kernel_params {
     bool skip_variance;
 } kernel_params;
 
+// Training g-mers of one mismatch profile with the mismatch positions removed, sorted
+typedef struct TrainProjection {
+    std::vector<int> combination;   // kept positions
+    std::vector<std::string> keys;
+    std::vector<int> groups;        // training sequence of each key
+} TrainProjection;
+
+// A block of test rows owned by one thread, with the distinct test g-mers occurring
+// in it and the range of BatchFeature::test_groups holding their owners in the block
+typedef struct RowBlock {
+    long int row_start;
+    long int row_end;
+    std::vector<int> gmers;
+    std::vector<int> owner_start;
+    std::vector<int> owner_end;
+} RowBlock;
+
 class KernelFunction {
     kernel_params* params;
 
@@ -35,7 +54,8 @@ public:
     double* compute_kernel();
     double* compute_test_kernel();
     void kernel_build_parallel(int, WorkItem*, int, pthread_mutex_t*, kernel_params*, double*);
-    void test_kernel_build_parallel(int, WorkItem*, int, pthread_mutex_t*, kernel_params*, double*);
+    void project_train(int, kernel_params*, TrainProjection*);
+    void test_kernel_rows(RowBlock*, TrainProjection*, int, kernel_params*, double*);
     double get_variance(unsigned int*, double*, double *, int, int, int);
 };
 
@@ -0,0 +1,119 @@
+#include "gmer_weights.hpp"
+#include "shared.h"
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <iostream>
+
+using namespace std;
+
+GmerWeights::GmerWeights(int g, int m, int alphabet_size) {
+    this->g = g;
+    this->m = m;
+    this->k = g - m;
+
+    // codes run from 0 (unknown character) to alphabet_size
+    this->bits = 1;
+    while ((1 << this->bits) <= alphabet_size) {
+        this->bits++;
+    }
+    if (this->k * this->bits > 64) {
+        throw runtime_error("g - m is too large to pack a g-mer projection into 64 bits for this alphabet");
+    }
+
+    int num_comb = nchoosek(g, m);
+    std::vector<int> positions;
+    for (int i = 0; i < g; i++) {
+        positions.push_back(i);
+    }
+    for (int c = 0; c < num_comb; c++) {
+        this->combos.push_back(getCombination(c, positions, this->k));
+    }
+    this->keys.resize(num_comb);
+    this->weights.resize(num_comb);
+}
+
+void GmerWeights::build(const SequenceSet &seqs, const vector<double> &seq_weights, int num_threads) {
+    int num_comb = this->combos.size();
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    num_threads = (num_threads > num_comb) ? num_comb : num_threads;
+
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+        threads.push_back(std::thread([this, tid, num_threads, num_comb, &seqs, &seq_weights]() {
+            for (int c = tid; c < num_comb; c += num_threads) {
+                this->build_combo(c, seqs, seq_weights);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+void GmerWeights::build_combo(int c, const SequenceSet &seqs, const vector<double> &seq_weights) {
+    const vector<int> &combination = this->combos[c];
+    int g = this->g;
+    int k = this->k;
+    int bits = this->bits;
+
+    // project every weighted training g-mer onto the kept positions
+    vector<pair<uint64_t, double> > projected;
+    for (size_t s = 0; s < seqs.size(); s++) {
+        if (seq_weights[s] == 0) continue;
+        const uint8_t *seq = seqs.data(s);
+        for (int p = 0; p + g <= seqs.length(s); p++) {
+            uint64_t key = 0;
+            for (int j = 0; j < k; j++) {
+                key |= ((uint64_t) seq[p + combination[j]]) << (bits * j);
+            }
+            projected.push_back(make_pair(key, seq_weights[s]));
+        }
+    }
+    sort(projected.begin(), projected.end(),
+        [](const pair<uint64_t, double> &a, const pair<uint64_t, double> &b) { return a.first < b.first; });
+
+    // collapse equal projections into one summed weight
+    vector<uint64_t> &keys = this->keys[c];
+    vector<double> &weights = this->weights[c];
+    keys.clear();
+    weights.clear();
+    for (size_t i = 0; i < projected.size(); i++) {
+        if (!keys.empty() && keys.back() == projected[i].first) {
+            weights.back() += projected[i].second;
+        } else {
+            keys.push_back(projected[i].first);
+            weights.push_back(projected[i].second);
+        }
+    }
+}
+
+double GmerWeights::gmer_weight(const uint8_t *gmer) const {
+    double w = 0;
+    int k = this->k;
+    int bits = this->bits;
+    for (size_t c = 0; c < this->combos.size(); c++) {
+        const vector<int> &combination = this->combos[c];
+        uint64_t key = 0;
+        for (int j = 0; j < k; j++) {
+            key |= ((uint64_t) gmer[combination[j]]) << (bits * j);
+        }
+        const vector<uint64_t> &keys = this->keys[c];
+        auto it = lower_bound(keys.begin(), keys.end(), key);
+        if (it != keys.end() && *it == key) {
+            w += this->weights[c][it - keys.begin()];
+        }
+    }
+    return w;
+}
+
+// out[p] receives the weight of the g-mer starting at position p, for p in [0, len - g]
+void GmerWeights::position_weights(const uint8_t *seq, int len, double *out) const {
+    for (int p = 0; p + this->g <= len; p++) {
+        out[p] = this->gmer_weight(seq + p);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef GMER_WEIGHTS_H
+#define GMER_WEIGHTS_H
+
+#include <vector>
+#include <stdint.h>
+#include "shared.h"
+
+using namespace std;
+
+/* Per g-mer contribution of a trained model to the SVM decision value.
+
+For the fastsk and linear kernels the decision value of a test sequence is
+additive over its g-mers: score(x) = sum_{a in x} w(a) - rho, where w(a) sums,
+over every mismatch profile (kept positions), the weights of the training
+g-mers that agree with a on the kept positions. GmerWeights precomputes one
+sorted table of projected training g-mers per mismatch profile so that w(a)
+can be evaluated for any g-mer without touching the training set again.
+This only holds for the exact kernel: the approximate kernel (-a) sums a sample
+of the mismatch profiles, so its models have no such table. */
+class GmerWeights {
+    int g;
+    int m;
+    int k;
+    int bits;                               // bits per symbol in a packed key
+    vector<vector<int> > combos;            // kept positions of each mismatch profile
+    vector<vector<uint64_t> > keys;         // sorted, unique projected g-mers per profile
+    vector<vector<double> > weights;        // summed weights, parallel to keys
+
+    void build_combo(int, const SequenceSet &, const vector<double> &);
+
+public:
+    GmerWeights(int, int, int);
+    void build(const SequenceSet &, const vector<double> &, int);
+    double gmer_weight(const uint8_t *) const;
+    void position_weights(const uint8_t *, int, double *) const;
+    int get_g() const { return g; }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "gram_matrix.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace std;
+
+// rows of G per block, and the tile sizes the block is computed in
+static const long gram_rows = 32;
+static const long gram_cols = 256;
+static const long gram_depth = 128;
+
+/* G = K * K^T for the packed n x n training kernel K, returned as a packed lower
+triangle allocated with malloc. Since K is symmetric, row i of G is
+sum_k K[i][k] * K[k], so the innermost loop runs along contiguous rows of K and
+vectorizes without reassociating any sums: every entry is accumulated in the same
+order as libsvm's dot product of the two kernel rows, and comes out identical.
+Threads claim blocks of rows of G, which are computed tile by tile so that the
+rows of K being read stay in cache. If columns is not NULL, the sum only runs over
+the k with columns[k] set. */
+double *linear_gram(const double *K, long n, int num_threads, const char *columns) {
+    vector<double> D(n * n);
+    for (long i = 0; i < n; i++) {
+        for (long j = 0; j <= i; j++) {
+            D[i * n + j] = D[j * n + i] = K[i * (i + 1) / 2 + j];
+        }
+    }
+
+    double *G = (double *) malloc(sizeof(double) * (n * (n + 1) / 2));
+    long num_blocks = (n + gram_rows - 1) / gram_rows;
+    num_threads = max(1L, min((long) num_threads, num_blocks));
+
+    // the last blocks are the largest, so hand them out first
+    atomic<long> next_block(0);
+    vector<thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(thread([&]() {
+            vector<double> C(gram_rows * n);
+            long b;
+            while ((b = next_block++) < num_blocks) {
+                long i0 = (num_blocks - 1 - b) * gram_rows;
+                long i1 = min(n, i0 + gram_rows);
+                fill(C.begin(), C.end(), 0);
+                for (long j0 = 0; j0 < i1; j0 += gram_cols) {
+                    long j1 = min(i1, j0 + gram_cols);
+                    for (long k0 = 0; k0 < n; k0 += gram_depth) {
+                        long k1 = min(n, k0 + gram_depth);
+                        for (long i = i0; i < i1; i++) {
+                            double *c = &C[(i - i0) * n];
+                            const double *a = &D[i * n];
+                            long j_end = min(j1, i + 1);
+                            for (long k = k0; k < k1; k++) {
+                                if (columns != NULL && !columns[k]) {
+                                    continue;
+                                }
+                                double aik = a[k];
+                                const double *row = &D[k * n];
+                                for (long j = j0; j < j_end; j++) {
+                                    c[j] += aik * row[j];
+                                }
+                            }
+                        }
+                    }
+                }
+                for (long i = i0; i < i1; i++) {
+                    copy(&C[(i - i0) * n], &C[(i - i0) * n] + i + 1, G + i * (i + 1) / 2);
+                }
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    return G;
+}
+
+/* Turn the packed Gram matrix G into the rbf kernel
+exp(-gamma * (G[i][i] + G[j][j] - 2 G[i][j])), in place, with the same arithmetic as
+libsvm's kernel_rbf. */
+void rbf_from_gram(double *G, long n, double gamma) {
+    vector<double> square(n);
+    for (long i = 0; i < n; i++) {
+        square[i] = G[i * (i + 1) / 2 + i];
+    }
+    for (long i = 0; i < n; i++) {
+        double *row = G + i * (i + 1) / 2;
+        for (long j = 0; j <= i; j++) {
+            row[j] = exp(-gamma * (square[i] + square[j] - 2 * row[j]));
+        }
+    }
+}
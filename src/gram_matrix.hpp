@@ -0,0 +1,14 @@
+#ifndef GRAM_MATRIX_H
+#define GRAM_MATRIX_H
+
+using namespace std;
+
+/* Second level kernels for the linear and rbf kernel types, whose feature vector
+for a training sequence is its row of the (symmetric) training kernel K. Both take
+and return n x n symmetric matrices as packed lower triangles. linear_gram can be
+limited to the feature columns of some of the sequences, such as the training part
+of a cross validation fold. */
+double *linear_gram(const double *, long, int, const char *);
+void rbf_from_gram(double *, long, double);
+
+#endif
@@ -1,7 +1,9 @@
 
 #include <Rcpp.h>
 #include <string>
+#include <climits>
 #include "fastsk.hpp"
+#include "prediction_file.hpp"
 using namespace Rcpp;
 
 //' FastSK: A Fast and Accurate GKM-SVM
@@ -21,15 +23,22 @@ using namespace Rcpp;
 //' @param skip_variance A boolean flag; if set to true, skip kernel standard deviation calculations and run until
 //'                 max_iters is reached. Default is False
 //' @param dictionary_file A file containing the alphabet of characters appearing in the sequences. If not provided, the dictionary will be inferred
+//' @param binary A boolean; if set to true, the kernel and the labels are written in a binary format holding the packed lower
+//'                 triangle of the kernel, which fastsk_train_and_score_kernel trains on without recomputing it, instead of
+//'                 as text. Default is False
 //' @export
 // [[Rcpp::export]]
 void fastsk_compute_kernel(std::string train_file, std::string test_file,  int g, int m, std::string kernel_file="kernel.out",
                         int t=1, bool approx=false, double delta=0.025, int max_iters=100, bool skip_variance=false,
-                        std::string dictionary_file="") {
+                        std::string dictionary_file="", bool binary=false) {
 
     FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
     fastsk->compute_kernel(train_file, test_file, dictionary_file);
-    fastsk->save_kernel(kernel_file);
+    if (binary) {
+        fastsk->save_binary_kernel(kernel_file);
+    } else {
+        fastsk->save_kernel(kernel_file);
+    }
 }
 
 //' FastSK: A Fast and Accurate GKM-SVM
@@ -69,3 +78,296 @@ void fastsk_train_and_score(std::string train_file, std::string test_file, int g
     fastsk->fit(C, nu, eps, kernel_type);
     fastsk->score(metric, metric_file);
 }
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_train_and_score_kernel
+//' @description Trains a gkm-svm on a kernel written by fastsk_compute_kernel with binary = TRUE or --save-kernel and scores
+//'                 on its test sequences, without computing the kernel. The kernel file is memory mapped rather than read
+//' @param kernel_file A binary kernel file
+//' @param t The number of threads to used. Default is 1
+//' @param C SVM C parameter. Default is 1.0
+//' @param nu SVM nu parameter. Default is 1.0
+//' @param eps SVM epsilon parameter. Default is 1.0
+//' @param kernel_type The kernel type to used. Must be one of linear (default), fastsk, or rbf
+//' @param metric The metric to score the test sequences with. Must be one of auc (default) or accuracy
+//' @param metric_file A filepath to write the test sequence predictions. Default is auc_file.txt
+//' @export
+// [[Rcpp::export]]
+void fastsk_train_and_score_kernel(std::string kernel_file, int t=1, double C=1.0, double nu=1.0, double eps=1.0,
+                        std::string kernel_type="linear", std::string metric="auc", std::string metric_file="auc_file.txt") {
+
+    FastSK* fastsk = new FastSK(0, 0, t, false, 0.025, 100, false);
+    fastsk->load_kernel(kernel_file);
+    fastsk->fit(C, nu, eps, kernel_type);
+    fastsk->score(metric, metric_file);
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_sweep_C
+//' @description Trains a gkm-svm for each of several C values and scores each on the test sequences. The kernel is computed once,
+//'                 and each training starts from the solution for the previous (larger) C, so this is faster than
+//'                 calling fastsk_train_and_score once per value
+//' @param train_file A FASTA file containing training sequences and their label
+//' @param test_file A FASTA file containing testing sequences and their label
+//' @param g The length of the substrings used to compare sequences. Constraints: \code{0 < g < 20}
+//' @param m The maximum number of mismatches when comparing two gmers Constraints: \code{0 <= m < g}
+//' @param C_values The SVM C parameters to train with
+//' @param t The number of threads to used. Default is 1
+//' @param approx A boolean; if set to true, then the fast approximation algorithm is used to compute the kernel. Default is False
+//' @param delta A numerical constant for early stopping of kernel calculation. If skip_variance is False,
+//'                 the kernel calculation will terminate when \code{delta / stdv > 1.96}. Default is 0.025
+//' @param max_iters The maximum number of iterations to run. Default is 100
+//' @param skip_variance A boolean flag; if set to true, skip kernel standard deviation calculations and run until
+//'                 max_iters is reached. Default is False
+//' @param nu SVM nu parameter. Default is 1.0
+//' @param eps SVM epsilon parameter. Default is 1.0
+//' @param kernel_type The kernel type to used. Must be one of linear (default), fastsk, or rbf
+//' @param dictionary_file A file containing the alphabet of characters appearing in the sequences.
+//'                 If not provided, the dictionary will be inferred
+//' @return A data frame with one row per C value, in the given order, with its number of support vectors,
+//'                 AUROC, AUPRC and accuracy on the test sequences
+//' @export
+// [[Rcpp::export]]
+DataFrame fastsk_sweep_C(std::string train_file, std::string test_file, int g, int m, NumericVector C_values,
+                        int t=1, bool approx=false, double delta=0.025, int max_iters=100,
+                        bool skip_variance=false, double nu=1.0, double eps=1.0,
+                        std::string kernel_type="linear", std::string dictionary_file="") {
+
+    FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+    fastsk->compute_kernel(train_file, test_file, dictionary_file);
+    vector<SweepResult> results = fastsk->sweep_C(as<vector<double> >(C_values), nu, eps, kernel_type);
+
+    NumericVector C(results.size()), auroc(results.size()), auprc(results.size()), accuracy(results.size());
+    IntegerVector num_sv(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        C[i] = results[i].C;
+        num_sv[i] = results[i].num_sv;
+        auroc[i] = results[i].auroc;
+        auprc[i] = results[i].auprc;
+        accuracy[i] = results[i].accuracy;
+    }
+    return DataFrame::create(Named("C") = C, Named("num_sv") = num_sv, Named("auroc") = auroc,
+                             Named("auprc") = auprc, Named("accuracy") = accuracy);
+}
+
+// The columns of an R label matrix as tasks, named after the column names if it has them
+static TaskLabels task_labels(IntegerMatrix labels) {
+    TaskLabels tasks;
+    CharacterVector names;
+    SEXP dimnames = Rf_getAttrib(labels, R_DimNamesSymbol);
+    if (!Rf_isNull(dimnames) && !Rf_isNull(VECTOR_ELT(dimnames, 1))) {
+        names = VECTOR_ELT(dimnames, 1);
+    }
+    for (int t = 0; t < labels.ncol(); t++) {
+        tasks.names.push_back(names.size() > t ? std::string(names[t]) : "task" + std::to_string(t + 1));
+        vector<int> column(labels.nrow());
+        for (int i = 0; i < labels.nrow(); i++) {
+            column[i] = (labels(i, t) == 1) ? 1 : -1;
+        }
+        tasks.labels.push_back(column);
+    }
+    return tasks;
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_train_and_score_tasks
+//' @description Trains one gkm-svm per column of a label matrix, such as the binding of many TFs to the same sequences, and scores
+//'                 each on the test sequences. The kernel and the test kernel are computed once and shared by all the models
+//' @param train_file A FASTA file containing training sequences. Their labels in the file are not used
+//' @param test_file A FASTA file containing testing sequences and their label
+//' @param g The length of the substrings used to compare sequences. Constraints: \code{0 < g < 20}
+//' @param m The maximum number of mismatches when comparing two gmers Constraints: \code{0 <= m < g}
+//' @param train_labels A matrix with a row per training sequence and a named column per task. Positive labels are 1 and
+//'                 negative labels 0 or -1
+//' @param test_labels A matrix of the same columns with a row per test sequence. If NULL (default), the labels in test_file are
+//'                 used for every task
+//' @param t The number of threads to used. Default is 1
+//' @param approx A boolean; if set to true, then the fast approximation algorithm is used to compute the kernel. Default is False
+//' @param delta A numerical constant for early stopping of kernel calculation. If skip_variance is False,
+//'                 the kernel calculation will terminate when \code{delta / stdv > 1.96}. Default is 0.025
+//' @param max_iters The maximum number of iterations to run. Default is 100
+//' @param skip_variance A boolean flag; if set to true, skip kernel standard deviation calculations and run until
+//'                 max_iters is reached. Default is False
+//' @param C SVM C parameter. Default is 1.0
+//' @param nu SVM nu parameter. Default is 1.0
+//' @param eps SVM epsilon parameter. Default is 1.0
+//' @param kernel_type The kernel type to used. Must be one of linear (default), fastsk, or rbf
+//' @param dictionary_file A file containing the alphabet of characters appearing in the sequences.
+//'                 If not provided, the dictionary will be inferred
+//' @param metric_prefix The test sequence predictions of each task are written to this prefix followed by the task name
+//'                 and .txt. Default is auc_file_
+//' @return A data frame with one row per task with its number of support vectors, AUROC, AUPRC and accuracy
+//' @export
+// [[Rcpp::export]]
+DataFrame fastsk_train_and_score_tasks(std::string train_file, std::string test_file, int g, int m,
+                        IntegerMatrix train_labels, Nullable<IntegerMatrix> test_labels=R_NilValue,
+                        int t=1, bool approx=false, double delta=0.025, int max_iters=100,
+                        bool skip_variance=false, double C=1.0, double nu=1.0, double eps=1.0,
+                        std::string kernel_type="linear", std::string dictionary_file="",
+                        std::string metric_prefix="auc_file_") {
+
+    FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+    fastsk->compute_kernel(train_file, test_file, dictionary_file);
+    TaskLabels train_tasks = task_labels(train_labels);
+    fastsk->fit_tasks(train_tasks, C, nu, eps, kernel_type);
+
+    vector<TaskResult> results;
+    if (test_labels.isNotNull()) {
+        TaskLabels test_tasks = task_labels(IntegerMatrix(test_labels.get()));
+        results = fastsk->score_tasks(&test_tasks, metric_prefix);
+    } else {
+        results = fastsk->score_tasks(NULL, metric_prefix);
+    }
+
+    CharacterVector task(results.size());
+    NumericVector auroc(results.size()), auprc(results.size()), accuracy(results.size());
+    IntegerVector num_sv(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        task[i] = results[i].name;
+        num_sv[i] = results[i].num_sv;
+        auroc[i] = results[i].auroc;
+        auprc[i] = results[i].auprc;
+        accuracy[i] = results[i].accuracy;
+    }
+    return DataFrame::create(Named("task") = task, Named("num_sv") = num_sv, Named("auroc") = auroc,
+                             Named("auprc") = auprc, Named("accuracy") = accuracy, Named("stringsAsFactors") = false);
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_cross_validate
+//' @description Stratified k-fold cross validation of a gkm-svm on the training sequences. The kernel is computed once and
+//'                 the folds train on parts of it without copying it, in parallel. With linear and rbf, each fold trains on a second level
+//'                 kernel of only the kernel columns of its own training sequences, as held out sequences must not be features, and
+//'                 the folds are trained one at a time
+//' @param train_file A FASTA file containing training sequences and their label
+//' @param g The length of the substrings used to compare sequences. Constraints: \code{0 < g < 20}
+//' @param m The maximum number of mismatches when comparing two gmers Constraints: \code{0 <= m < g}
+//' @param nfold The number of folds. Default is 5
+//' @param t The number of threads to used. Default is 1
+//' @param approx A boolean; if set to true, then the fast approximation algorithm is used to compute the kernel. Default is False
+//' @param delta A numerical constant for early stopping of kernel calculation. If skip_variance is False,
+//'                 the kernel calculation will terminate when \code{delta / stdv > 1.96}. Default is 0.025
+//' @param max_iters The maximum number of iterations to run. Default is 100
+//' @param skip_variance A boolean flag; if set to true, skip kernel standard deviation calculations and run until
+//'                 max_iters is reached. Default is False
+//' @param C SVM C parameter. Default is 1.0
+//' @param nu SVM nu parameter. Default is 1.0
+//' @param eps SVM epsilon parameter. Default is 1.0
+//' @param kernel_type The kernel type to used. Must be one of linear (default), fastsk, or rbf
+//' @param dictionary_file A file containing the alphabet of characters appearing in the sequences.
+//'                 If not provided, the dictionary will be inferred
+//' @return A data frame with one row per fold and a last row, fold "pooled", for all the held out predictions together,
+//'                 with the numbers of training and held out sequences, the number of support vectors, AUROC, AUPRC and
+//'                 accuracy. The held out sequences are scored by decision value
+//' @export
+// [[Rcpp::export]]
+DataFrame fastsk_cross_validate(std::string train_file, int g, int m, int nfold=5,
+                        int t=1, bool approx=false, double delta=0.025, int max_iters=100,
+                        bool skip_variance=false, double C=1.0, double nu=1.0, double eps=1.0,
+                        std::string kernel_type="linear", std::string dictionary_file="") {
+
+    FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+    DataReader* data_reader = new DataReader(train_file, dictionary_file);
+    data_reader->read_data(train_file, true);
+    fastsk->compute_train(data_reader->train_seq, data_reader->train_labels.data());
+    vector<FoldResult> results = fastsk->cross_validate(nfold, C, nu, eps, kernel_type);
+
+    CharacterVector fold(results.size());
+    IntegerVector num_train(results.size()), num_test(results.size()), num_sv(results.size());
+    NumericVector auroc(results.size()), auprc(results.size()), accuracy(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        fold[i] = (results[i].fold == 0) ? "pooled" : std::to_string(results[i].fold);
+        num_train[i] = results[i].num_train;
+        num_test[i] = results[i].num_test;
+        num_sv[i] = results[i].num_sv;
+        auroc[i] = results[i].auroc;
+        auprc[i] = results[i].auprc;
+        accuracy[i] = results[i].accuracy;
+    }
+    return DataFrame::create(Named("fold") = fold, Named("num_train") = num_train, Named("num_test") = num_test,
+                             Named("num_sv") = num_sv, Named("auroc") = auroc, Named("auprc") = auprc,
+                             Named("accuracy") = accuracy, Named("stringsAsFactors") = false);
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_save_model
+//' @description Trains a gkm-svm and writes it to a binary model bundle holding the kernel parameters, the dictionary,
+//'                 the support sequences and the SVM coefficients, which fastsk_score_model scores test sequences with
+//'                 without the training file. Only for two class models
+//' @param train_file A FASTA file containing training sequences and their label
+//' @param g The length of the substrings used to compare sequences. Constraints: \code{0 < g < 20}
+//' @param m The maximum number of mismatches when comparing two gmers Constraints: \code{0 <= m < g}
+//' @param model_file A filepath to write the model bundle to
+//' @param t The number of threads to used. Default is 1
+//' @param approx A boolean; if set to true, then the fast approximation algorithm is used to compute the kernel. Default is False
+//' @param delta A numerical constant for early stopping of kernel calculation. If skip_variance is False,
+//'                 the kernel calculation will terminate when \code{delta / stdv > 1.96}. Default is 0.025
+//' @param max_iters The maximum number of iterations to run. Default is 100
+//' @param skip_variance A boolean flag; if set to true, skip kernel standard deviation calculations and run until
+//'                 max_iters is reached. Default is False
+//' @param C SVM C parameter. Default is 1.0
+//' @param nu SVM nu parameter. Default is 1.0
+//' @param eps SVM epsilon parameter. Default is 1.0
+//' @param kernel_type The kernel type to used. Must be one of linear (default), fastsk, or rbf
+//' @param dictionary_file A file containing the alphabet of characters appearing in the sequences.
+//'                 If not provided, the dictionary will be inferred
+//' @export
+// [[Rcpp::export]]
+void fastsk_save_model(std::string train_file, int g, int m, std::string model_file,
+                        int t=1, bool approx=false, double delta=0.025, int max_iters=100,
+                        bool skip_variance=false, double C=1.0, double nu=1.0, double eps=1.0,
+                        std::string kernel_type="linear", std::string dictionary_file="") {
+
+    FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+    DataReader* data_reader = new DataReader(train_file, dictionary_file);
+    data_reader->read_data(train_file, true);
+    fastsk->compute_train(data_reader->train_seq, data_reader->train_labels.data());
+    fastsk->set_dictionary(data_reader->dictmap);
+    fastsk->fit(C, nu, eps, kernel_type);
+    fastsk->save_model(model_file);
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_score_model
+//' @description Scores test sequences with a model bundle written by fastsk_save_model or --save-model. The bundle is memory
+//'                 mapped and holds everything needed, so there is no training step. The predictions are written to
+//'                 auc_pred_file.txt
+//' @param model_file A model bundle
+//' @param test_file A FASTA file containing testing sequences and their label
+//' @param t The number of threads to used. Default is 1
+//' @param batch_size The number of test sequences to compute the kernel and predict for at a time. Default is 0, for all
+//'                 of them at once
+//' @export
+// [[Rcpp::export]]
+void fastsk_score_model(std::string model_file, std::string test_file, int t=1, int batch_size=0) {
+    FastSK* fastsk = new FastSK(0, 0, t, false, 0.025, 100, false);
+    fastsk->load_model(model_file);
+    FastaSource source(test_file, fastsk->get_dictionary());
+    fastsk->score_stream(source, (batch_size > 0) ? batch_size : INT_MAX);
+}
+
+//' FastSK: A Fast and Accurate GKM-SVM
+//'
+//' @name fastsk_read_predictions
+//' @description Reads a binary predictions file written with --pred-binary. The file is memory mapped, so only the scores and labels are copied
+//' @param pred_file A binary predictions file, such as auc_pred_file.bin
+//' @return A list with \code{score}, the predicted probability of each test sequence stored as float32, and \code{label}, their labels,
+//'                 or NULL when the file was written without labels
+//' @export
+// [[Rcpp::export]]
+List fastsk_read_predictions(std::string pred_file) {
+    PredictionFile predictions(pred_file);
+
+    NumericVector score(predictions.scores, predictions.scores + predictions.n);
+    if (predictions.labels == NULL) {
+        return List::create(Named("score") = score, Named("label") = R_NilValue);
+    }
+    IntegerVector label(predictions.labels, predictions.labels + predictions.n);
+    return List::create(Named("score") = score, Named("label") = label);
+}
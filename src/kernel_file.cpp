@@ -0,0 +1,96 @@
+#include "kernel_file.hpp"
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char kernel_magic[8] = {'F', 'S', 'K', 'K', 'R', 'N', '0', '1'};
+
+// Labels are padded to an even count so that the kernel is 8 byte aligned
+static int64_t padded_labels(int64_t n) {
+    return n + (n & 1);
+}
+
+/* Write the packed kernel K of n_train training and n_test test sequences. header
+holds g, m, n_train, n_test and nfeat; the rest of it is filled in here. */
+void write_kernel_file(const string path, KernelHeader header, const int *train_labels, const int *test_labels, const double *K) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        printf("Error: could not open kernel file %s\n", path.c_str());
+        exit(1);
+    }
+    memcpy(header.magic, kernel_magic, sizeof(header.magic));
+    header.layout = KERNEL_PACKED_LOWER;
+    header.element_size = sizeof(double);
+    fwrite(&header, sizeof(header), 1, file);
+
+    int64_t n = header.n_train + header.n_test;
+    fwrite(train_labels, sizeof(int32_t), header.n_train, file);
+    fwrite(test_labels, sizeof(int32_t), header.n_test, file);
+    if (padded_labels(n) != n) {
+        int32_t pad = 0;
+        fwrite(&pad, sizeof(int32_t), 1, file);
+    }
+    fwrite(K, sizeof(double), n * (n + 1) / 2, file);
+
+    if (ferror(file) || fclose(file) != 0) {
+        printf("Error: could not write kernel file %s\n", path.c_str());
+        exit(1);
+    }
+    printf("Wrote the kernel (%ld x %ld) to %s\n", (long) n, (long) n, path.c_str());
+}
+
+KernelFile::KernelFile(const string path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Could not open kernel file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(KernelHeader)) {
+        ::close(fd);
+        throw runtime_error(path + " is not a kernel file");
+    }
+    this->map_size = st.st_size;
+    this->map = mmap(NULL, this->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (this->map == MAP_FAILED) {
+        throw runtime_error("Could not map kernel file " + path);
+    }
+
+    const KernelHeader *header = (const KernelHeader *) this->map;
+    // bounded so that the size of the kernel cannot overflow
+    const int64_t max_count = (int64_t) 1 << 29;
+    bool valid = memcmp(header->magic, kernel_magic, sizeof(kernel_magic)) == 0
+        && header->n_train > 0 && header->n_train < max_count
+        && header->n_test >= 0 && header->n_test < max_count
+        && header->n_train + header->n_test < max_count
+        // g and m as FastSK requires them, and a feature count that gives a finite, positive rbf gamma
+        && header->g > 0 && header->m >= 0 && header->m < header->g
+        && header->nfeat > 0 && header->nfeat <= INT32_MAX;
+    int64_t n = header->n_train + header->n_test;
+    size_t expected = !valid ? 0 : sizeof(KernelHeader) + sizeof(int32_t) * padded_labels(n)
+        + sizeof(double) * (n * (n + 1) / 2);
+    if (!valid || this->map_size < expected) {
+        munmap(this->map, this->map_size);
+        throw runtime_error(path + " is not a kernel file");
+    }
+    if (header->layout != KERNEL_PACKED_LOWER || header->element_size != sizeof(double)) {
+        munmap(this->map, this->map_size);
+        throw runtime_error(path + " holds a kernel layout or element type that is not supported");
+    }
+
+    this->header = header;
+    this->labels = (int *) (header + 1);
+    this->K = (double *) (this->labels + padded_labels(n));
+}
+
+KernelFile::~KernelFile() {
+    munmap(this->map, this->map_size);
+}
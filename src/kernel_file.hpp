@@ -0,0 +1,51 @@
+#ifndef KERNEL_FILE_H
+#define KERNEL_FILE_H
+
+#include <string>
+#include <stdint.h>
+
+using namespace std;
+
+// Layouts of the kernel in a kernel file
+#define KERNEL_PACKED_LOWER 0       // lower triangle of the symmetric matrix, row by row
+
+/* Binary kernel file layout, in native byte order:
+    char    magic[8]        "FSKKRN01"
+    int32   g, m            g-mer length and mismatches the kernel was computed with
+    int32   layout          KERNEL_PACKED_LOWER
+    int32   element_size    bytes per kernel entry, 8 for float64
+    int64   n_train         training sequences, which come first
+    int64   n_test          test sequences
+    int64   nfeat           number of g-mer features, which sets the rbf gamma
+    int32   labels[n_train + n_test], padded to a multiple of 8 bytes
+    float64 K[n (n + 1) / 2]    the n = n_train + n_test square kernel, as FastSK::K
+The kernel starts at a multiple of 8 bytes, so a mapped file can be used in place. */
+typedef struct KernelHeader {
+    char magic[8];
+    int32_t g;
+    int32_t m;
+    int32_t layout;
+    int32_t element_size;
+    int64_t n_train;
+    int64_t n_test;
+    int64_t nfeat;
+} KernelHeader;
+
+void write_kernel_file(const string, KernelHeader, const int *, const int *, const double *);
+
+/* Memory mapping of a kernel file. The mapping is private and writable, as FastSK
+takes K and the labels as non-const pointers, but nothing is written back. */
+class KernelFile {
+    void *map;
+    size_t map_size;
+
+public:
+    const KernelHeader *header;
+    int *labels;                    // training labels, then test labels
+    double *K;
+
+    KernelFile(const string);
+    ~KernelFile();
+};
+
+#endif
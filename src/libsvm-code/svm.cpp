@@ -10,6 +10,12 @@
 #include "svm.h"
 #include "eval.h"
 #include "../fastsk_kernel.hpp"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
@@ -187,6 +193,13 @@ void Cache::swap_index(int i, int j)
 	}
 }
 
+// Entry (i,j) of a symmetric matrix stored as its packed lower triangle
+template <class T> static inline double packed_value(const T *K, long i, long j)
+{
+	if(j > i) swap(i,j);
+	return K[i*(i+1)/2+j];
+}
+
 //
 // Kernel evaluation
 //
@@ -215,11 +228,35 @@ public:
 	{
 		swap(x[i],x[j]);
 		if(x_square) swap(x_square[i],x_square[j]);
+		if(sample_id) swap(sample_id[i],sample_id[j]);
 	}
 protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
 
+	// Entries [start,len) of column i of the label-signed Q matrix for the fastsk
+	// kernel, gathered straight from the packed kernel: the entries of smaller sample
+	// ids lie in the packed row of sample i, the others each in their own row
+	void fastsk_column(int i, int start, int len, const schar *y, Qfloat *data) const
+	{
+		if(kernel_matrix_float)
+			fastsk_column(kernel_matrix_float,i,start,len,y,data);
+		else
+			fastsk_column(kernel_matrix,i,start,len,y,data);
+	}
+	template <class T> void fastsk_column(const T *K, int i, int start, int len, const schar *y, Qfloat *data) const
+	{
+		long id_i = sample_id[i];
+		const T *row_i = K + id_i*(id_i+1)/2;
+		double yi = y[i];
+		for(int j=start;j<len;j++)
+		{
+			long id_j = sample_id[j];
+			double k = (id_j <= id_i) ? row_i[id_j] : K[id_j*(id_j+1)/2+id_i];
+			data[j] = (Qfloat)(yi*y[j]*k);
+		}
+	}
+
 private:
 	const svm_node **x;
 	double *x_square;
@@ -230,13 +267,20 @@ private:
 	
 	const double gamma;
 	const double coef0;
+	const double *kernel_matrix;
+	const float *kernel_matrix_float;
+	long *sample_id;	// for FASTSK, the id held by each x[i]
 
 	//static double fastsk_dot(const svm_node *px, const svm_node *py);
 	static double dot(const svm_node *px, const svm_node *py);
 
+	// x[i] is a single node holding the sample id, so the value follows x[i] through
+	// the grouping permutation and swap_index
 	double kernel_fastsk(int i, int j) const
 	{
-    	return x[i][j].value;
+		if(kernel_matrix_float)
+			return packed_value(kernel_matrix_float, sample_id[i], sample_id[j]);
+		return packed_value(kernel_matrix, sample_id[i], sample_id[j]);
 	}
 	double kernel_linear(int i, int j) const
 	{
@@ -262,7 +306,8 @@ private:
 
 Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 :kernel_type(param.kernel_type), degree(param.degree),
- gamma(param.gamma), coef0(param.coef0)
+ gamma(param.gamma), coef0(param.coef0), kernel_matrix(param.kernel_matrix),
+ kernel_matrix_float(param.kernel_matrix_float)
 {
 	this->l = l; //so we can use it to access elements with only x and y values
 
@@ -298,12 +343,22 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 	}
 	else
 		x_square = 0;
+
+	if(kernel_type == FASTSK)
+	{
+		sample_id = new long[l];
+		for(int i=0;i<l;i++)
+			sample_id[i] = (long)x[i][0].value;
+	}
+	else
+		sample_id = 0;
 }
 
 Kernel::~Kernel()
 {
 	delete[] x;
 	delete[] x_square;
+	delete[] sample_id;
 }
 
 
@@ -383,13 +438,182 @@ double Kernel::k_function(const svm_node *x, const svm_node *y,
 			return tanh(param.gamma*dot(x,y)+param.coef0);
 		case PRECOMPUTED:  //x: test (validation), y: SV
 			return x[(int)(y->value)].value;
-		case FASTSK:
-			return 0;//*(x).value;
+		case FASTSK:  //x: training sample id or kernel row against the training set, y: SV id
+			if(x->index == 0 && param.kernel_matrix_float)
+				return packed_value(param.kernel_matrix_float,(long)x->value,(long)y->value);
+			if(x->index == 0)
+				return packed_value(param.kernel_matrix,(long)x->value,(long)y->value);
+			return x[(int)(y->value)].value;
 		default:
 			return 0;  // Unreachable 
 	}
 }
 
+// Threads busy in Solver::Solve across all the solvers running at once, such as
+// the probability folds or the tasks of a multi-task fit: one per calling thread
+// and one per team worker. Teams only get workers while this is below the number
+// of cores, so that the solvers together do not ask for more threads than there
+// are cores.
+static std::mutex solver_threads_mutex;
+static std::atomic<int> solver_threads(0);
+
+static int solver_cores()
+{
+	static const int cores = max(1,(int)std::thread::hardware_concurrency());
+	return cores;
+}
+
+// Count the calling thread and up to nr_thread-1 workers, as many as there are idle
+// cores for, and return the number of threads counted
+static int claim_solver_threads(int nr_thread)
+{
+	std::lock_guard<std::mutex> lock(solver_threads_mutex);
+	int granted = 1+max(0,min(nr_thread-1,solver_cores()-solver_threads-1));
+	solver_threads += granted;
+	return granted;
+}
+
+static void release_solver_threads(int nr_thread)
+{
+	solver_threads -= nr_thread;
+}
+
+// Whether more solver threads are running than there are cores, when a thread that
+// spins waiting for another only takes time from threads with work to do
+static bool solver_threads_oversubscribed()
+{
+	return solver_threads > solver_cores();
+}
+
+// Threads that share the O(l) loops of one Solver::Solve. A loop is split into
+// contiguous parts, one per thread, the calling thread taking the first. Loops
+// come once or twice per SMO iteration and can take only microseconds, so
+// between them the threads spin for a while before going to sleep, and at once
+// if the solvers' threads outnumber the cores.
+class SolverTeam {
+public:
+	SolverTeam(int nr_thread);
+	~SolverTeam();
+	int size() const { return nr_thread; }
+	void run(int nr_part, int begin, int end, const std::function<void(int,int,int)> &fn);
+private:
+	int nr_thread;
+	std::vector<std::thread> workers;
+	std::atomic<unsigned> generation;
+	std::atomic<int> sleepers;
+	std::atomic<int> remaining;
+	std::atomic<bool> waiting;	// whether the calling thread sleeps until remaining is 0
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stop;
+	// the current loop
+	const std::function<void(int,int,int)> *fn;
+	int nr_part, begin, end;
+
+	void work(int part);
+	void worker(int part);
+	void start();
+};
+
+SolverTeam::SolverTeam(int nr_thread)
+{
+	this->nr_thread = nr_thread;
+	generation = 0;
+	sleepers = 0;
+	remaining = 0;
+	waiting = false;
+	stop = false;
+	fn = NULL;
+	nr_part = 0;
+	for(int t=1;t<nr_thread;t++)
+		workers.push_back(std::thread(&SolverTeam::worker,this,t));
+}
+
+SolverTeam::~SolverTeam()
+{
+	stop = true;
+	start();
+	for(size_t t=0;t<workers.size();t++)
+		workers[t].join();
+}
+
+void SolverTeam::work(int part)
+{
+	int n = end-begin;
+	(*fn)(part,begin+(int)((long)n*part/nr_part),begin+(int)((long)n*(part+1)/nr_part));
+}
+
+// Publish the current loop (or stop) to the workers
+void SolverTeam::start()
+{
+	generation++;
+	if(sleepers > 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake.notify_all();
+	}
+}
+
+void SolverTeam::worker(int part)
+{
+	unsigned seen = 0;
+	for(;;)
+	{
+		for(int spin=0;generation == seen;spin++)
+		{
+			if(spin < (1<<16) && !solver_threads_oversubscribed())
+			{
+				if((spin & 255) == 255)
+					std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			sleepers++;
+			wake.wait(lock,[&]() { return generation != seen; });
+			sleepers--;
+		}
+		seen = generation;
+		if(stop)
+			return;
+		if(part < nr_part)
+			work(part);
+		// every worker checks in, so none can still be reading this loop's
+		// parameters when the next one is published
+		if(--remaining == 0 && waiting)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_one();
+		}
+	}
+}
+
+// Call fn(part,part_begin,part_end) for nr_part (at most size()) contiguous parts
+// of [begin,end) and return when all are done
+void SolverTeam::run(int nr_part, int begin, int end, const std::function<void(int,int,int)> &fn)
+{
+	this->fn = &fn;
+	this->nr_part = nr_part;
+	this->begin = begin;
+	this->end = end;
+	remaining = nr_thread-1;
+	start();
+	work(0);
+	for(int spin=0;remaining > 0;spin++)
+	{
+		if(spin < (1<<16) && !solver_threads_oversubscribed())
+		{
+			if((spin & 255) == 255)
+				std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		waiting = true;
+		done.wait(lock,[&]() { return remaining == 0; });
+		waiting = false;
+	}
+}
+
 // An SMO algorithm in Fan et al., JMLR 6(2005), p. 1889--1918
 // Solves:
 //
@@ -423,9 +647,10 @@ public:
 
 	void Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		   double *alpha_, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking);
+		   SolutionInfo* si, int shrinking, int nr_thread = 1);
 protected:
 	int active_size;
+	SolverTeam *team;	// NULL when the loops run on the calling thread only
 	schar *y;
 	double *G;		// gradient of objective function
 	enum { LOWER_BOUND, UPPER_BOUND, FREE };
@@ -456,11 +681,40 @@ protected:
 	bool is_upper_bound(int i) { return alpha_status[i] == UPPER_BOUND; }
 	bool is_lower_bound(int i) { return alpha_status[i] == LOWER_BOUND; }
 	bool is_free(int i) { return alpha_status[i] == FREE; }
+
+	// Parts to split a loop of n elements into: one unless each thread of the
+	// team gets enough elements to be worth waking it for
+	int nr_part(int n) const
+	{
+		if(team == NULL)
+			return 1;
+		return max(1,min(team->size(),n/4096));
+	}
+	// fn(part,part_begin,part_end) over nr_part contiguous parts of [begin,end)
+	template<class F> void parallel_for(int nr_part, int begin, int end, F fn)
+	{
+		if(nr_part == 1)
+			fn(0,begin,end);
+		else
+			team->run(nr_part,begin,end,std::function<void(int,int,int)>(fn));
+	}
+	// v[k] += a*Q_i[k] over [begin,end), in parallel
+	void add_column(double *v, double a, const Qfloat *Q_i, int begin, int end)
+	{
+		parallel_for(nr_part(end-begin),begin,end,[=](int part, int b, int e) {
+			for(int k=b;k<e;k++)
+				v[k] += a*Q_i[k];
+		});
+	}
 	void swap_index(int i, int j);
 	void reconstruct_gradient();
 	virtual int select_working_set(int &i, int &j);
 	virtual double calculate_rho();
 	virtual void do_shrinking();
+	void select_i(int begin, int end, double &Gmax, int &Gmax_idx);
+	void select_j(int i, const Qfloat *Q_i, double Gmax, int begin, int end,
+		double &Gmax2, double &obj_diff_min, int &Gmin_idx);
+	void max_violations(int begin, int end, double &Gmax1, double &Gmax2);
 private:
 	bool be_shrunk(int i, double Gmax1, double Gmax2);
 };
@@ -486,8 +740,10 @@ void Solver::reconstruct_gradient()
 	int i,j;
 	int nr_free = 0;
 
-	for(j=active_size;j<l;j++)
-		G[j] = G_bar[j] + p[j];
+	parallel_for(nr_part(l-active_size),active_size,l,[this](int part, int b, int e) {
+		for(int k=b;k<e;k++)
+			G[k] = G_bar[k] + p[k];
+	});
 
 	for(j=0;j<active_size;j++)
 		if(is_free(j))
@@ -512,17 +768,22 @@ void Solver::reconstruct_gradient()
 			if(is_free(i))
 			{
 				const Qfloat *Q_i = Q->get_Q(i,l);
-				double alpha_i = alpha[i];
-				for(j=active_size;j<l;j++)
-					G[j] += alpha_i * Q_i[j];
+				add_column(G,alpha[i],Q_i,active_size,l);
 			}
 	}
 }
 
+// The gradient updates, working set selection and gradient reconstruction are
+// split between up to nr_thread threads once the active set is large enough, as
+// many as there are idle cores for (see claim_solver_threads). Every element is
+// computed as it would be by one thread, and ties in the selection go to the same
+// index, so the result does not depend on the number of threads.
 void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		   double *alpha_, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking)
+		   SolutionInfo* si, int shrinking, int nr_thread)
 {
+	nr_thread = claim_solver_threads(l >= 2*4096 ? nr_thread : 1);
+	team = (nr_thread > 1) ? new SolverTeam(nr_thread) : NULL;
 	this->l = l;
 	this->Q = &Q;
 	QD=Q.get_QD();
@@ -563,13 +824,9 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			if(!is_lower_bound(i))
 			{
 				const Qfloat *Q_i = Q.get_Q(i,l);
-				double alpha_i = alpha[i];
-				int j;
-				for(j=0;j<l;j++)
-					G[j] += alpha_i*Q_i[j];
+				add_column(G,alpha[i],Q_i,0,l);
 				if(is_upper_bound(i))
-					for(j=0;j<l;j++)
-						G_bar[j] += get_C(i) * Q_i[j];
+					add_column(G_bar,get_C(i),Q_i,0,l);
 			}
 	}
 
@@ -710,10 +967,12 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		double delta_alpha_i = alpha[i] - old_alpha_i;
 		double delta_alpha_j = alpha[j] - old_alpha_j;
 		
-		for(int k=0;k<active_size;k++)
-		{
-			G[k] += Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j;
-		}
+		parallel_for(nr_part(active_size),0,active_size,[=](int part, int b, int e) {
+			for(int k=b;k<e;k++)
+			{
+				G[k] += Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j;
+			}
+		});
 
 		// update alpha_status and G_bar
 
@@ -722,27 +981,17 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			bool uj = is_upper_bound(j);
 			update_alpha_status(i);
 			update_alpha_status(j);
-			int k;
+			// adding -C is the same as subtracting C
 			if(ui != is_upper_bound(i))
 			{
 				Q_i = Q.get_Q(i,l);
-				if(ui)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_i * Q_i[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_i * Q_i[k];
+				add_column(G_bar,ui ? -C_i : C_i,Q_i,0,l);
 			}
 
 			if(uj != is_upper_bound(j))
 			{
 				Q_j = Q.get_Q(j,l);
-				if(uj)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_j * Q_j[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_j * Q_j[k];
+				add_column(G_bar,uj ? -C_j : C_j,Q_j,0,l);
 			}
 		}
 	}
@@ -799,24 +1048,15 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	delete[] active_set;
 	delete[] G;
 	delete[] G_bar;
+	release_solver_threads(team ? team->size() : 1);
+	delete team;
 }
 
-// return 1 if already optimal, return 0 otherwise
-int Solver::select_working_set(int &out_i, int &out_j)
+// Over t in [begin,end): the last t maximizing -y_t * grad(f)_t, t in I_up(\alpha),
+// if it is at least Gmax
+void Solver::select_i(int begin, int end, double &Gmax, int &Gmax_idx)
 {
-	// return i,j such that
-	// i: maximizes -y_i * grad(f)_i, i in I_up(\alpha)
-	// j: minimizes the decrease of obj value
-	//    (if quadratic coefficeint <= 0, replace it with tau)
-	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
-	
-	double Gmax = -INF;
-	double Gmax2 = -INF;
-	int Gmax_idx = -1;
-	int Gmin_idx = -1;
-	double obj_diff_min = INF;
-
-	for(int t=0;t<active_size;t++)
+	for(int t=begin;t<end;t++)
 		if(y[t]==+1)	
 		{
 			if(!is_upper_bound(t))
@@ -835,13 +1075,14 @@ int Solver::select_working_set(int &out_i, int &out_j)
 					Gmax_idx = t;
 				}
 		}
+}
 
-	int i = Gmax_idx;
-	const Qfloat *Q_i = NULL;
-	if(i != -1) // NULL Q_i not accessed: Gmax=-INF if i=-1
-		Q_i = Q->get_Q(i,active_size);
-
-	for(int j=0;j<active_size;j++)
+// Over j in [begin,end): the largest y_j * grad(f)_j, j in I_low(\alpha), into Gmax2,
+// and the last j minimizing the decrease of obj value, if it is at most obj_diff_min
+void Solver::select_j(int i, const Qfloat *Q_i, double Gmax, int begin, int end,
+	double &Gmax2, double &obj_diff_min, int &Gmin_idx)
+{
+	for(int j=begin;j<end;j++)
 	{
 		if(y[j]==+1)
 		{
@@ -892,6 +1133,74 @@ int Solver::select_working_set(int &out_i, int &out_j)
 			}
 		}
 	}
+}
+
+// return 1 if already optimal, return 0 otherwise
+int Solver::select_working_set(int &out_i, int &out_j)
+{
+	// return i,j such that
+	// i: maximizes -y_i * grad(f)_i, i in I_up(\alpha)
+	// j: minimizes the decrease of obj value
+	//    (if quadratic coefficeint <= 0, replace it with tau)
+	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
+	
+	double Gmax = -INF;
+	double Gmax2 = -INF;
+	int Gmax_idx = -1;
+	int Gmin_idx = -1;
+	double obj_diff_min = INF;
+
+	// Each part scans its range as the serial loop would. Ties go to the last
+	// index, so merging the parts in order, taking a part's pick whenever it is at
+	// least as good, picks the same i and j.
+	int nr_part = this->nr_part(active_size);
+
+	if(nr_part == 1)
+		select_i(0,active_size,Gmax,Gmax_idx);
+	else
+	{
+		std::vector<double> part_G(nr_part);
+		std::vector<int> part_idx(nr_part);
+		parallel_for(nr_part,0,active_size,[&](int part, int b, int e) {
+			part_G[part] = -INF;
+			part_idx[part] = -1;
+			select_i(b,e,part_G[part],part_idx[part]);
+		});
+		for(int part=0;part<nr_part;part++)
+			if(part_idx[part] != -1 && part_G[part] >= Gmax)
+			{
+				Gmax = part_G[part];
+				Gmax_idx = part_idx[part];
+			}
+	}
+
+	int i = Gmax_idx;
+	const Qfloat *Q_i = NULL;
+	if(i != -1) // NULL Q_i not accessed: Gmax=-INF if i=-1
+		Q_i = Q->get_Q(i,active_size);
+
+	if(nr_part == 1)
+		select_j(i,Q_i,Gmax,0,active_size,Gmax2,obj_diff_min,Gmin_idx);
+	else
+	{
+		std::vector<double> part_G2(nr_part), part_obj(nr_part);
+		std::vector<int> part_idx(nr_part);
+		parallel_for(nr_part,0,active_size,[&](int part, int b, int e) {
+			part_G2[part] = -INF;
+			part_obj[part] = INF;
+			part_idx[part] = -1;
+			select_j(i,Q_i,Gmax,b,e,part_G2[part],part_obj[part],part_idx[part]);
+		});
+		for(int part=0;part<nr_part;part++)
+		{
+			Gmax2 = max(Gmax2,part_G2[part]);
+			if(part_idx[part] != -1 && part_obj[part] <= obj_diff_min)
+			{
+				Gmin_idx = part_idx[part];
+				obj_diff_min = part_obj[part];
+			}
+		}
+	}
 
 	if(Gmax+Gmax2 < eps || Gmin_idx == -1){
 		return 1;
@@ -922,14 +1231,11 @@ bool Solver::be_shrunk(int i, double Gmax1, double Gmax2)
 		return(false);
 }
 
-void Solver::do_shrinking()
+// Over [begin,end): the largest -y_i * grad(f)_i, i in I_up(\alpha), into Gmax1, and
+// the largest y_i * grad(f)_i, i in I_low(\alpha), into Gmax2
+void Solver::max_violations(int begin, int end, double &Gmax1, double &Gmax2)
 {
-	int i;
-	double Gmax1 = -INF;		// max { -y_i * grad(f)_i | i in I_up(\alpha) }
-	double Gmax2 = -INF;		// max { y_i * grad(f)_i | i in I_low(\alpha) }
-
-	// find maximal violating pair first
-	for(i=0;i<active_size;i++)
+	for(int i=begin;i<end;i++)
 	{
 		if(y[i]==+1)	
 		{
@@ -958,6 +1264,25 @@ void Solver::do_shrinking()
 			}
 		}
 	}
+}
+
+void Solver::do_shrinking()
+{
+	int i;
+	double Gmax1 = -INF;		// max { -y_i * grad(f)_i | i in I_up(\alpha) }
+	double Gmax2 = -INF;		// max { y_i * grad(f)_i | i in I_low(\alpha) }
+
+	// find maximal violating pair first
+	int nr_part = this->nr_part(active_size);
+	std::vector<double> part_G1(nr_part,-INF), part_G2(nr_part,-INF);
+	parallel_for(nr_part,0,active_size,[&](int part, int b, int e) {
+		max_violations(b,e,part_G1[part],part_G2[part]);
+	});
+	for(int part=0;part<nr_part;part++)
+	{
+		Gmax1 = max(Gmax1,part_G1[part]);
+		Gmax2 = max(Gmax2,part_G2[part]);
+	}
 
 	if(unshrink == false && Gmax1 + Gmax2 <= eps*10) 
 	{
@@ -1032,10 +1357,10 @@ public:
 	Solver_NU() {}
 	void Solve(int l, const QMatrix& Q, const double *p, const schar *y,
 		   double *alpha, double Cp, double Cn, double eps,
-		   SolutionInfo* si, int shrinking)
+		   SolutionInfo* si, int shrinking, int nr_thread = 1)
 	{
 		this->si = si;
-		Solver::Solve(l,Q,p,y,alpha,Cp,Cn,eps,si,shrinking);
+		Solver::Solve(l,Q,p,y,alpha,Cp,Cn,eps,si,shrinking,nr_thread);
 	}
 private:
 	SolutionInfo *si;
@@ -1283,6 +1608,37 @@ double Solver_NU::calculate_rho()
 //
 // Q matrices for various formulations
 //
+// The fastsk kernel is already in memory, so the cache of a fastsk solver could hold
+// every column and never evict one, at l*l Qfloats. Solvers that run at once, such
+// as the probability folds, sweep chains and tasks, share one such cache's worth of
+// memory, that of the largest of them: each gets what is left of it when it starts,
+// and at least the cache_size of any other kernel.
+static std::mutex fastsk_cache_mutex;
+static long int fastsk_cache_budget = 0;
+static long int fastsk_cache_in_use = 0;
+static int fastsk_cache_users = 0;
+
+// The cache size of a solver for l samples, at most its full size, which is what
+// release_fastsk_cache is given back
+static long int claim_fastsk_cache(int l, long int cache_bytes)
+{
+	std::lock_guard<std::mutex> lock(fastsk_cache_mutex);
+	long int full = (long int)l*(long int)(l*sizeof(Qfloat)+64);
+	fastsk_cache_budget = max(fastsk_cache_budget,full);
+	long int granted = min(full,max(cache_bytes,fastsk_cache_budget-fastsk_cache_in_use));
+	fastsk_cache_in_use += granted;
+	fastsk_cache_users++;
+	return granted;
+}
+
+static void release_fastsk_cache(long int granted)
+{
+	std::lock_guard<std::mutex> lock(fastsk_cache_mutex);
+	fastsk_cache_in_use -= granted;
+	if(--fastsk_cache_users == 0)
+		fastsk_cache_budget = 0;
+}
+
 class SVC_Q: public Kernel
 { 
 public:
@@ -1290,10 +1646,15 @@ public:
 	:Kernel(prob.l, prob.x, param)
 	{
 		clone(y,y_,prob.l);
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		long int cache_bytes = (long int)(param.cache_size*(1<<20));
+		fastsk_cache = 0;
+		if(param.kernel_type == FASTSK)
+			cache_bytes = fastsk_cache = claim_fastsk_cache(prob.l,cache_bytes);
+		cache = new Cache(prob.l,cache_bytes);
 		QD = new double[prob.l];
 		for(int i=0;i<prob.l;i++)
 			QD[i] = (this->*kernel_function)(i,i);
+		fastsk = (param.kernel_type == FASTSK);
 	}
 	
 	Qfloat *get_Q(int i, int len) const
@@ -1302,8 +1663,11 @@ public:
 		int start, j;
 		if((start = cache->get_data(i,&data,len)) < len)
 		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
+			if(fastsk)
+				fastsk_column(i,start,len,y,data);
+			else
+				for(j=start;j<len;j++)
+					data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
 		}
 		return data;
 	}
@@ -1326,11 +1690,15 @@ public:
 		delete[] y;
 		delete cache;
 		delete[] QD;
+		if(fastsk)
+			release_fastsk_cache(fastsk_cache);
 	}
 private:
 	schar *y;
 	Cache *cache;
 	double *QD;
+	bool fastsk;
+	long int fastsk_cache;	// cache size from claim_fastsk_cache
 };
 
 class ONE_CLASS_Q: public Kernel
@@ -1459,7 +1827,8 @@ private:
 //
 static void solve_c_svc(
 	const svm_problem *prob, const svm_parameter* param,
-	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn)
+	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn,
+	const double *init_alpha)
 {
 	int l = prob->l;
 	double *minus_ones = new double[l];
@@ -1467,16 +1836,17 @@ static void solve_c_svc(
 
 	int i;
 
+	// the solver starts from init_alpha if given; it must be feasible
 	for(i=0;i<l;i++)
 	{
-		alpha[i] = 0;
+		alpha[i] = init_alpha ? init_alpha[i] : 0;
 		minus_ones[i] = -1;
 		if(prob->y[i] > 0) y[i] = +1; else y[i] = -1;
 	}
 
 	Solver s;
 	s.Solve(l, SVC_Q(*prob,*param,y), minus_ones, y,
-		alpha, Cp, Cn, param->eps, si, param->shrinking);
+		alpha, Cp, Cn, param->eps, si, param->shrinking, param->nr_thread);
 
 	double sum_alpha=0;
 	for(i=0;i<l;i++)
@@ -1530,7 +1900,7 @@ static void solve_nu_svc(
 
 	Solver_NU s;
 	s.Solve(l, SVC_Q(*prob,*param,y), zeros, y,
-		alpha, 1.0, 1.0, param->eps, si,  param->shrinking);
+		alpha, 1.0, 1.0, param->eps, si,  param->shrinking, param->nr_thread);
 	double r = si->r;
 
 	info("C = %f\n",1/r);
@@ -1573,7 +1943,7 @@ static void solve_one_class(
 
 	Solver s;
 	s.Solve(l, ONE_CLASS_Q(*prob,*param), zeros, ones,
-		alpha, 1.0, 1.0, param->eps, si, param->shrinking);
+		alpha, 1.0, 1.0, param->eps, si, param->shrinking, param->nr_thread);
 
 	delete[] zeros;
 	delete[] ones;
@@ -1602,7 +1972,7 @@ static void solve_epsilon_svr(
 
 	Solver s;
 	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
-		alpha2, param->C, param->C, param->eps, si, param->shrinking);
+		alpha2, param->C, param->C, param->eps, si, param->shrinking, param->nr_thread);
 
 	double sum_alpha = 0;
 	for(i=0;i<l;i++)
@@ -1643,7 +2013,7 @@ static void solve_nu_svr(
 
 	Solver_NU s;
 	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
-		alpha2, C, C, param->eps, si, param->shrinking);
+		alpha2, C, C, param->eps, si, param->shrinking, param->nr_thread);
 
 	info("epsilon = %f\n",-si->r);
 
@@ -1666,14 +2036,14 @@ struct decision_function
 
 static decision_function svm_train_one(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn)
+	double Cp, double Cn, const double *init_alpha)
 {
 	double *alpha = Malloc(double,prob->l);
 	Solver::SolutionInfo si;
 	switch(param->svm_type)
 	{
 		case C_SVC:
-			solve_c_svc(prob,param,alpha,&si,Cp,Cn);
+			solve_c_svc(prob,param,alpha,&si,Cp,Cn,init_alpha);
 			break;
 		case NU_SVC:
 			solve_nu_svc(prob,param,alpha,&si);
@@ -1909,7 +2279,77 @@ static void multiclass_probability(int k, double **r, double *p)
 	free(Qp);
 }
 
-// Cross-validation decision values for probability estimates
+// Decision values of the samples perm[begin,end) from a model trained on the others
+static void svm_probability_fold(
+	const svm_problem *prob, const svm_parameter *param,
+	double Cp, double Cn, const int *perm, int begin, int end, double *dec_values)
+{
+	int j,k;
+	struct svm_problem subprob;
+
+	subprob.l = prob->l-(end-begin);
+	subprob.x = Malloc(struct svm_node*,subprob.l);
+	subprob.y = Malloc(double,subprob.l);
+		
+	k=0;
+	for(j=0;j<begin;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	for(j=end;j<prob->l;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	int p_count=0,n_count=0;
+	for(j=0;j<k;j++)
+		if(subprob.y[j]>0)
+			p_count++;
+		else
+			n_count++;
+
+	if(p_count==0 && n_count==0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 0;
+	else if(p_count > 0 && n_count == 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 1;
+	else if(p_count == 0 && n_count > 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = -1;
+	else
+	{
+		svm_parameter subparam = *param;
+		subparam.probability=0;
+		subparam.C=1.0;
+		subparam.nr_weight=2;
+		subparam.weight_label = Malloc(int,2);
+		subparam.weight = Malloc(double,2);
+		subparam.weight_label[0]=+1;
+		subparam.weight_label[1]=-1;
+		subparam.weight[0]=Cp;
+		subparam.weight[1]=Cn;
+		struct svm_model *submodel = svm_train(&subprob,&subparam);
+		for(j=begin;j<end;j++)
+		{
+			svm_predict_values(submodel,prob->x[perm[j]],&(dec_values[perm[j]]));
+			// ensure +1 -1 order; reason not using CV subroutine
+			dec_values[perm[j]] *= submodel->label[0];
+		}		
+		svm_free_and_destroy_model(&submodel);
+		svm_destroy_param(&subparam);
+	}
+	free(subprob.x);
+	free(subprob.y);
+}
+
+// Cross-validation for the Platt sigmoid. The folds are drawn before any is trained
+// and write disjoint decision values, so training them on param->nr_thread threads
+// gives the same result as one thread. The sub-problems only hold pointers to the
+// samples' nodes; with FASTSK these are sample ids into the shared packed kernel.
 static void svm_binary_svc_probability(
 	const svm_problem *prob, const svm_parameter *param,
 	double Cp, double Cn, double& probA, double& probB)
@@ -1926,71 +2366,28 @@ static void svm_binary_svc_probability(
 		int j = i+rand()%(prob->l-i);
 		swap(perm[i],perm[j]);
 	}
-	for(i=0;i<nr_fold;i++)
-	{
-		int begin = i*prob->l/nr_fold;
-		int end = (i+1)*prob->l/nr_fold;
-		int j,k;
-		struct svm_problem subprob;
-
-		subprob.l = prob->l-(end-begin);
-		subprob.x = Malloc(struct svm_node*,subprob.l);
-		subprob.y = Malloc(double,subprob.l);
-			
-		k=0;
-		for(j=0;j<begin;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		for(j=end;j<prob->l;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		int p_count=0,n_count=0;
-		for(j=0;j<k;j++)
-			if(subprob.y[j]>0)
-				p_count++;
-			else
-				n_count++;
 
-		if(p_count==0 && n_count==0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 0;
-		else if(p_count > 0 && n_count == 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 1;
-		else if(p_count == 0 && n_count > 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = -1;
-		else
-		{
-			svm_parameter subparam = *param;
-			subparam.probability=0;
-			subparam.C=1.0;
-			subparam.nr_weight=2;
-			subparam.weight_label = Malloc(int,2);
-			subparam.weight = Malloc(double,2);
-			subparam.weight_label[0]=+1;
-			subparam.weight_label[1]=-1;
-			subparam.weight[0]=Cp;
-			subparam.weight[1]=Cn;
-			struct svm_model *submodel = svm_train(&subprob,&subparam);
-			for(j=begin;j<end;j++)
+	// the folds split the threads between them, no more than there are cores
+	int total_thread = min(param->nr_thread,solver_cores());
+	int nr_thread = max(1,min(total_thread,nr_fold));
+	svm_parameter fold_param = *param;
+	fold_param.nr_thread = max(1,total_thread/nr_thread);
+	const svm_parameter *fold_paramp = &fold_param;
+	std::vector<std::thread> threads;
+	for(int t=0;t<nr_thread;t++)
+	{
+		threads.push_back(std::thread([=]() {
+			for(int f=t;f<nr_fold;f+=nr_thread)
 			{
-				svm_predict_values(submodel,prob->x[perm[j]],&(dec_values[perm[j]]));
-				// ensure +1 -1 order; reason not using CV subroutine
-				dec_values[perm[j]] *= submodel->label[0];
-			}		
-			svm_free_and_destroy_model(&submodel);
-			svm_destroy_param(&subparam);
-		}
-		free(subprob.x);
-		free(subprob.y);
-	}		
+				int begin = f*prob->l/nr_fold;
+				int end = (f+1)*prob->l/nr_fold;
+				svm_probability_fold(prob,fold_paramp,Cp,Cn,perm,begin,end,dec_values);
+			}
+		}));
+	}
+	for(int t=0;t<nr_thread;t++)
+		threads[t].join();
+
 	sigmoid_train(prob->l,dec_values,prob->y,probA,probB);
 	free(dec_values);
 	free(perm);
@@ -2106,10 +2503,53 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 	free(data_label);
 }
 
+// For each sample of the class-grouped problem (x[i] = prob->x[perm[i]]), its
+// position among the SVs of init, or -1. NULL if init was not trained on the same
+// problem with the same classes, as far as can be told.
+static int *svm_warm_start_positions(const svm_problem *prob, const svm_model *init,
+	int nr_class, const int *label, const int *perm)
+{
+	int l = prob->l;
+	if(init->param.svm_type != C_SVC || init->nr_class != nr_class || init->sv_indices == NULL)
+		return NULL;
+	for(int i=0;i<nr_class;i++)
+		if(init->label[i] != label[i])
+			return NULL;
+
+	int *inverse = Malloc(int,l);
+	for(int i=0;i<l;i++)
+		inverse[perm[i]] = i;
+	int *pos = Malloc(int,l);
+	for(int i=0;i<l;i++)
+		pos[i] = -1;
+	for(int s=0;s<init->l;s++)
+	{
+		int orig = init->sv_indices[s]-1;
+		if(orig < 0 || orig >= l)
+		{
+			free(inverse);
+			free(pos);
+			return NULL;
+		}
+		pos[inverse[orig]] = s;
+	}
+	free(inverse);
+	return pos;
+}
+
 //
 // Interface functions
 //
 svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	return svm_train_warm(prob,param,NULL);
+}
+
+// svm_train, with the C_SVC solver started from the solution of init, a model
+// trained on the same problem with another C. Its alphas are kept as they are for
+// a larger C, and scaled down by the ratio of the C values for a smaller one, so
+// that they stay feasible. The probability folds still start from zero.
+svm_model *svm_train_warm(const svm_problem *prob, const svm_parameter *param, const svm_model *init)
 {
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
@@ -2134,7 +2574,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 			model->probA[0] = svm_svr_probability(prob,param);
 		}
 
-		decision_function f = svm_train_one(prob,param,0,0);
+		decision_function f = svm_train_one(prob,param,0,0,NULL);
 		model->rho = Malloc(double,1);
 		model->rho[0] = f.rho;
 
@@ -2195,6 +2635,14 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 				weighted_C[j] *= param->weight[i];
 		}
 
+		int *warm_pos = NULL;
+		if(init != NULL && param->svm_type == C_SVC)
+		{
+			warm_pos = svm_warm_start_positions(prob,init,nr_class,label,perm);
+			if(warm_pos == NULL)
+				info("WARNING: model to warm start from does not match the problem; starting from zero\n");
+		}
+
 		// train k*(k-1)/2 models
 		
 		bool *nonzero = Malloc(bool,l);
@@ -2234,7 +2682,27 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 				if(param->probability)
 					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
 
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
+				// classifier (i,j) of init has the alphas of class i in
+				// sv_coef[j-1] and those of class j in sv_coef[i], times +-1
+				double *init_alpha = NULL;
+				if(warm_pos != NULL)
+				{
+					double ratio = min(1.0,param->C / init->param.C);
+					init_alpha = Malloc(double,sub_prob.l);
+					for(k=0;k<ci;k++)
+					{
+						int s = warm_pos[si+k];
+						init_alpha[k] = (s < 0) ? 0 : min(fabs(init->sv_coef[j-1][s])*ratio,weighted_C[i]);
+					}
+					for(k=0;k<cj;k++)
+					{
+						int s = warm_pos[sj+k];
+						init_alpha[ci+k] = (s < 0) ? 0 : min(fabs(init->sv_coef[i][s])*ratio,weighted_C[j]);
+					}
+				}
+
+				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j],init_alpha);
+				free(init_alpha);
 				for(k=0;k<ci;k++)
 					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
 						nonzero[si+k] = true;
@@ -2342,6 +2810,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		free(probB);
 		free(count);
 		free(perm);
+		free(warm_pos);
 		free(start);
 		free(x);
 		free(weighted_C);
@@ -2518,6 +2987,40 @@ double svm_get_svr_probability(const svm_model *model)
 	}
 }
 
+// Clamped Platt probability of the first class for a two-class decision value
+double svm_binary_probability(double dec_value, double A, double B)
+{
+	double min_prob=1e-7;
+	return min(max(sigmoid_predict(dec_value,A,B),min_prob),1-min_prob);
+}
+
+// Two-class C_SVC/NU_SVC prediction without any allocation. Sums the support
+// vectors in the same order as svm_predict_values, so results are identical.
+double svm_predict_values_binary(const svm_model *model, const svm_node *x, double *dec_value)
+{
+	double *coef = model->sv_coef[0];
+	double sum = 0;
+	for(int i=0;i<model->l;i++)
+	{
+		sum += coef[i] * Kernel::k_function(x,model->SV[i],model->param);
+	}
+	sum -= model->rho[0];
+	*dec_value = sum;
+	return (sum > 0) ? model->label[0] : model->label[1];
+}
+
+double svm_predict_probability_binary(const svm_model *model, const svm_node *x, double *prob_estimates)
+{
+	double dec_value;
+	double label = svm_predict_values_binary(model, x, &dec_value);
+	if (model->probA == NULL || model->probB == NULL)
+		return label;
+
+	prob_estimates[0] = svm_binary_probability(dec_value, model->probA[0], model->probB[0]);
+	prob_estimates[1] = 1-prob_estimates[0];
+	return (prob_estimates[1] > prob_estimates[0]) ? model->label[1] : model->label[0];
+}
+
 double svm_predict_values(const svm_model *model, const svm_node *x, double* dec_values)
 {
 	int i;
@@ -2537,6 +3040,8 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 		else
 			return sum;
 	}
+	else if (model->nr_class == 2)
+		return svm_predict_values_binary(model, x, dec_values);
 	else
 	{
 		int nr_class = model->nr_class;
@@ -2544,12 +3049,8 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 		
 		double *kvalue = Malloc(double,l);
 		for(i=0;i<l;i++)
-			if (model->param.kernel_type == FASTSK){
-				kvalue[i] = x[model->sv_indices[i]-1].value;
-			}else{
-				kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
-			}
-			
+			kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
+
 		int *start = Malloc(int,nr_class);
 		start[0] = 0;
 		for(i=1;i<nr_class;i++)
@@ -2602,6 +3103,11 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 double svm_predict(const svm_model *model, const svm_node *x)
 {
 	int nr_class = model->nr_class;
+	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) && nr_class == 2)
+	{
+		double dec_value;
+		return svm_predict_values_binary(model, x, &dec_value);
+	}
 	double *dec_values;
 	if(model->param.svm_type == ONE_CLASS ||
 	   model->param.svm_type == EPSILON_SVR ||
@@ -2618,6 +3124,9 @@ double svm_predict_probability(
 	const svm_model *model, const svm_node *x, double *prob_estimates)
 {
 	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+	    model->probA!=NULL && model->probB!=NULL && model->nr_class == 2)
+		return svm_predict_probability_binary(model, x, prob_estimates);
+	else if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
 	    model->probA!=NULL && model->probB!=NULL)
 	{
 		int i;
@@ -2793,6 +3302,9 @@ bool read_model_header(FILE *fp, svm_model* model)
 	param.nr_weight = 0;
 	param.weight_label = NULL;
 	param.weight = NULL;
+	param.kernel_matrix = NULL;
+	param.kernel_matrix_float = NULL;
+	param.nr_thread = 1;
 
 	char cmd[81];
 	while(1)
@@ -3078,6 +3590,9 @@ const char *svm_check_parameter(const svm_problem *prob, const svm_parameter *pa
 	// if (kernel_type != FASTSK)
 	// 	return "unknown kernel type";
 
+	if(param->kernel_type == FASTSK && param->kernel_matrix == NULL && param->kernel_matrix_float == NULL)
+		return "fastsk kernel requires kernel_matrix";
+
 	if(param->gamma < 0)
 		return "gamma < 0";
 
@@ -45,6 +45,9 @@ struct svm_parameter
 	double p;	/* for EPSILON_SVR */
 	int shrinking;	/* use the shrinking heuristics */
 	int probability; /* do probability estimates */
+	double *kernel_matrix;	/* for FASTSK: packed lower triangular training kernel, indexed by sample id */
+	float *kernel_matrix_float;	/* for FASTSK: the same kernel in single precision, read instead of kernel_matrix if set */
+	int nr_thread;	/* threads for the probability cross-validation folds and the solver's loops */
 };
 
 //
@@ -73,6 +76,7 @@ struct svm_model
 };
 
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
+struct svm_model *svm_train_warm(const struct svm_problem *prob, const struct svm_parameter *param, const struct svm_model *init);
 void svm_cross_validation(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target);
 
 int svm_save_model(const char *model_file_name, const struct svm_model *model);
@@ -88,6 +92,9 @@ double svm_get_svr_probability(const struct svm_model *model);
 double svm_predict_values(const struct svm_model *model, const struct svm_node *x, double* dec_values);
 double svm_predict(const struct svm_model *model, const struct svm_node *x);
 double svm_predict_probability(const struct svm_model *model, const struct svm_node *x, double* prob_estimates);
+double svm_predict_values_binary(const struct svm_model *model, const struct svm_node *x, double *dec_value);
+double svm_predict_probability_binary(const struct svm_model *model, const struct svm_node *x, double *prob_estimates);
+double svm_binary_probability(double dec_value, double A, double B);
 
 void svm_free_model_content(struct svm_model *model_ptr);
 void svm_free_and_destroy_model(struct svm_model **model_ptr_ptr);
@@ -1,13 +1,51 @@
 #include "fastsk.hpp"
 #include <string>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <climits>
 
 #include "utils.hpp"
+#include "sequence_source.hpp"
+#include "prediction_file.hpp"
 
 using namespace std;
 
+// Parse a comma separated list of numbers
+static bool parse_list(const char *arg, vector<double> &values) {
+    while (*arg != '\0') {
+        char *end;
+        values.push_back(strtod(arg, &end));
+        if (end == arg || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+/* The kernel of the one-shot, sweep and task modes: read from a file written by
+--save-kernel, or computed from the training and test files and then saved if
+save_kernel is given. */
+static void one_shot_kernel(FastSK *fastsk, const string &load_kernel, const string &save_kernel, const string &train_file, const string &test_file, const string &dictionary_file) {
+    if (!load_kernel.empty()) {
+        try {
+            fastsk->load_kernel(load_kernel);
+        } catch (const std::exception &e) {
+            printf("Error: %s\n", e.what());
+            exit(1);
+        }
+    } else {
+        fastsk->compute_kernel(train_file, test_file, dictionary_file);
+    }
+    if (!save_kernel.empty()) {
+        fastsk->save_binary_kernel(save_kernel);
+    }
+}
+
 int help() {
     printf("\nUsage: fastsk [options] <trainingFile> <testFile> <dictionaryFile> <labelsFile>\n");
     printf("FLAGS WITH ARGUMENTS\n");
@@ -18,12 +56,38 @@ int help() {
     printf("\t r : (optional) Kernel type. Must be linear (default), fastsk, or rbf\n");
     printf("\t I : (optional) Maximum number of iterations. Default 100. The number of mismatch positions to sample when running the approximation algorithm.\n");
     printf("\t b : (optional) Batch size for FastSK-batch. The number of testing sequences to use in a batch to compute the kernel and predict.\n");
+    printf("\t mem-budget : (optional) Memory budget for FastSK-batch, in MB. Each batch is made as large as fits in the budget, given the number of training sequences, the number of threads and the lengths of the test sequences. With -b, batches are also capped at that size.\n");
+    printf("\t kmers : (optional) Score every sequence of this length over the dictionary, in lexicographic order, instead of reading a test file. Requires -b or --mem-budget. The testFile parameter is then omitted.\n");
+    printf("\t kmer-range : (optional) With --kmers, only score sequences START to END-1 of the enumeration, given as START:END\n");
+    printf("\t kmer-shard : (optional) With --kmers, only score shard I of N equal shards of the enumeration, given as I/N\n");
+    printf("\t top-k : (optional) With -b, --mem-budget or --kmers, write only the N highest and N lowest scoring test sequences, by decision value, instead of a prediction per sequence. Memory does not grow with the number of sequences scored.\n");
+    printf("\t top-k-out : (optional) Output file for --top-k. Default top_k.txt\n");
+    printf("\t sweep-C : (optional) Train and score once per value in this comma separated list of C values, instead of once with -C, reusing the kernel and warm starting each training from the previous C. Writes the metrics of each value to --sweep-out. Not available with -b or --mem-budget.\n");
+    printf("\t sweep-out : (optional) Output file for --sweep-C. Default c_sweep.txt\n");
+    printf("\t tasks : (optional) Train one model per column of this tab separated label matrix, whose header line names the tasks and which has a line of labels per training sequence, all over one kernel. Each task's test predictions go to auc_file_<task>.txt and its metrics to --tasks-out. Not available with -b or --mem-budget.\n");
+    printf("\t test-tasks : (optional) Label matrix of the test sequences for --tasks, with the same columns. If not given, the labels of the test file are used for every task.\n");
+    printf("\t tasks-out : (optional) Output file for --tasks. Default tasks.txt\n");
+    printf("\t cv : (optional) Stratified cross validation with this many folds on the training file instead of training and testing. With the fastsk kernel, the folds are trained in parallel on the one training kernel. With linear and rbf, whose feature vectors are kernel rows, each fold builds a second level kernel from only the kernel columns of its own training sequences, so that the held out sequences are not features of the model, and the folds are trained one at a time. The AUROC, AUPRC and accuracy of each fold and of all held out predictions pooled go to --cv-out. The testFile parameter is then omitted.\n");
+    printf("\t cv-out : (optional) Output file for --cv. Default cv.txt\n");
+    printf("\t save-model : (optional) After training, write the model to this file as a binary bundle of the kernel parameters, the dictionary, the support sequences and the SVM coefficients, so that test sequences can be scored later with --load-model without the training file. Only in the one-shot mode and with -b or --mem-budget, for two class models.\n");
+    printf("\t load-model : (optional) Score the test file with a model bundle written by --save-model instead of training: -g, -m, the kernel and the dictionary come from the bundle, and the trainingFile and dictionaryFile parameters are omitted. Predictions go to auc_pred_file.txt, in batches of -b or --mem-budget if given, and --top-k can be used with either.\n");
+    printf("\t save-kernel : (optional) Write the kernel of the training and test files, with their labels, to this file in a binary format holding the packed lower triangle of the kernel, so that it can be trained on again with --load-kernel without recomputing it. Only in the one-shot, sweep-C and tasks modes.\n");
+    printf("\t load-kernel : (optional) Train and score on a kernel written by --save-kernel instead of computing one. The file is memory mapped rather than read. -g, -m and the labels come from the file, and the trainingFile, testFile and dictionaryFile parameters are omitted. Only in the one-shot, sweep-C and tasks modes, and --save-model is not available as the sequences are not in the file.\n");
+    printf("\t scan : (optional) Train, then score every window of the sequences in this (multi-line) FASTA file, such as a genome, and write a bedGraph-style track. The testFile parameter is then omitted. Not available with -a, as the scores are computed from every mismatch profile rather than the sampled ones.\n");
+    printf("\t window : (optional) Window length for --scan. Default 200\n");
+    printf("\t stride : (optional) Distance between consecutive windows for --scan. Default 50\n");
+    printf("\t scan-out : (optional) Output file for --scan. Default scan.bedgraph\n");
+    printf("\t convert-predictions : (optional) Convert the binary predictions file IN to the CSV format written without --pred-binary and exit, given as IN OUT. No other parameters are needed.\n");
+    printf("\t ism : (optional) In-silico saturation mutagenesis. Train, then write the change in decision value of every single-base substitution of each test sequence to this file. Not available with -a, as the changes are computed from every mismatch profile rather than the sampled ones.\n");
     printf("NO ARGUMENT FLAGS\n");
     printf("\t a : (optional) Approximation. If set, the fast approximation algorithm will be used to compute the kernel function\n");
     printf("\t q : (optional) Quiet mode. If set, Kernel computation and SVM training info won't be printed.\n");
+    printf("\t ism-binary : (optional) Write the ISM matrices as binary float32 instead of TSV.\n");
+    printf("\t float-kernel : (optional) Train the SVM on a single precision (float32) copy of the kernel, halving the memory the solver reads for kernel values. Gradients are still accumulated in double, but results can differ slightly from the default double precision kernel.\n");
+    printf("\t pred-binary : (optional) Write predictions as a binary file of float32 scores followed by int8 labels (no labels with --kmers), with a .bin extension instead of .txt.\n");
     printf("ORDERED PARAMETERS\n");
     printf("\t trainingFile : set of training examples in FASTA format\n");
-    printf("\t testingFile : set of testing examples in FASTA format\n");
+    printf("\t testingFile : set of testing examples in FASTA format. Omitted when --kmers is given\n");
     printf("\t dictionaryFile : (optional) file containing the alphabet of characters that appear in the sequences. If not provided, a dictionary will be inferred from the training file.\n");
     printf("\n");
     printf("\nExample usage:\n");
@@ -45,17 +109,75 @@ int main(int argc, char* argv[]) {
     bool approx = false;
     int max_iters = 100;
     int batch_size = 0;
+    double mem_budget = 0;
     double delta = 0.025;
     bool skip_variance = false;
     string kernel_type = "linear";
+    string ism_file;
+    bool ism_binary = false;
+    int kmer_length = -1;
+    uint64_t kmer_start = 0;
+    uint64_t kmer_end = UINT64_MAX;
+    int kmer_shard = -1;
+    int kmer_num_shards = -1;
+    string scan_file;
+    string scan_out = "scan.bedgraph";
+    int window = 200;
+    int stride = 50;
+    bool pred_binary = false;
+    string convert_file;
+    int top_k = 0;
+    string top_k_out = "top_k.txt";
+    vector<double> sweep_values;
+    string sweep_out = "c_sweep.txt";
+    string tasks_file;
+    string test_tasks_file;
+    string tasks_out = "tasks.txt";
+    bool float_kernel = false;
+    int nfold = 0;
+    string cv_out = "cv.txt";
+    string save_model;
+    string load_model;
+    string save_kernel;
+    string load_kernel;
 
     // SVM params
     double C = 1.0;
     double nu = 1;
     double eps = 1;
 
+    static struct option long_options[] = {
+        {"ism", required_argument, 0, 1000},
+        {"ism-binary", no_argument, 0, 1001},
+        {"kmers", required_argument, 0, 1002},
+        {"kmer-range", required_argument, 0, 1003},
+        {"kmer-shard", required_argument, 0, 1004},
+        {"scan", required_argument, 0, 1005},
+        {"window", required_argument, 0, 1006},
+        {"stride", required_argument, 0, 1007},
+        {"scan-out", required_argument, 0, 1008},
+        {"mem-budget", required_argument, 0, 1009},
+        {"pred-binary", no_argument, 0, 1010},
+        {"convert-predictions", required_argument, 0, 1011},
+        {"top-k", required_argument, 0, 1012},
+        {"top-k-out", required_argument, 0, 1013},
+        {"sweep-C", required_argument, 0, 1014},
+        {"sweep-out", required_argument, 0, 1015},
+        {"tasks", required_argument, 0, 1016},
+        {"test-tasks", required_argument, 0, 1017},
+        {"tasks-out", required_argument, 0, 1018},
+        {"float-kernel", no_argument, 0, 1019},
+        {"cv", required_argument, 0, 1020},
+        {"cv-out", required_argument, 0, 1021},
+        {"save-model", required_argument, 0, 1022},
+        {"load-model", required_argument, 0, 1023},
+        {"save-kernel", required_argument, 0, 1024},
+        {"load-kernel", required_argument, 0, 1025},
+        {0, 0, 0, 0}
+    };
+
     int c;
-    while ((c = getopt(argc, argv, "g:m:t:I:b:C:r:aq")) != -1) {
+    while ((c = getopt_long(argc, argv, "g:m:t:I:b:C:r:aq", long_options, NULL)) != -1) {
         switch (c) {
             case 'g':
                 g = atoi(optarg);
@@ -67,10 +189,11 @@ int main(int argc, char* argv[]) {
                 t = atoi(optarg);
                 break;
             case 'I':
-                t = atoi(optarg);
+                max_iters = atoi(optarg);
                 break;
             case 'b':
                 batch_size = atoi(optarg);
+                break;
             case 'C':
                 C = atof(optarg);
                 break;
@@ -83,15 +206,159 @@ int main(int argc, char* argv[]) {
             case 'q':
                 quiet = 1;
                 break;
-            break;
+            case 1000:
+                ism_file = optarg;
+                break;
+            case 1001:
+                ism_binary = true;
+                break;
+            case 1002:
+                kmer_length = atoi(optarg);
+                break;
+            case 1003:
+                if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &kmer_start, &kmer_end) != 2) {
+                    printf("kmer-range must be given as START:END\n");
+                    return help();
+                }
+                break;
+            case 1004:
+                if (sscanf(optarg, "%d/%d", &kmer_shard, &kmer_num_shards) != 2) {
+                    printf("kmer-shard must be given as I/N\n");
+                    return help();
+                }
+                break;
+            case 1005:
+                scan_file = optarg;
+                break;
+            case 1006:
+                window = atoi(optarg);
+                break;
+            case 1007:
+                stride = atoi(optarg);
+                break;
+            case 1008:
+                scan_out = optarg;
+                break;
+            case 1009:
+                mem_budget = atof(optarg);
+                break;
+            case 1010:
+                pred_binary = true;
+                break;
+            case 1011:
+                convert_file = optarg;
+                break;
+            case 1012:
+                top_k = atoi(optarg);
+                break;
+            case 1013:
+                top_k_out = optarg;
+                break;
+            case 1014:
+                if (!parse_list(optarg, sweep_values)) {
+                    printf("sweep-C must be a comma separated list of numbers\n");
+                    return help();
+                }
+                break;
+            case 1015:
+                sweep_out = optarg;
+                break;
+            case 1016:
+                tasks_file = optarg;
+                break;
+            case 1017:
+                test_tasks_file = optarg;
+                break;
+            case 1018:
+                tasks_out = optarg;
+                break;
+            case 1019:
+                float_kernel = true;
+                break;
+            case 1020:
+                nfold = atoi(optarg);
+                break;
+            case 1021:
+                cv_out = optarg;
+                break;
+            case 1022:
+                save_model = optarg;
+                break;
+            case 1023:
+                load_model = optarg;
+                break;
+            case 1024:
+                save_kernel = optarg;
+                break;
+            case 1025:
+                load_kernel = optarg;
+                break;
+        }
+    }
+
+    // Binary predictions to CSV //
+    if (!convert_file.empty()) {
+        if (optind >= argc) {
+            printf("convert-predictions needs an input and an output file\n");
+            return help();
+        }
+        try {
+            convert_predictions(convert_file, argv[optind]);
+        } catch (const std::exception &e) {
+            printf("Error: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    // Scoring with a saved model //
+    if (!load_model.empty()) {
+        if (kmer_length > 0 || !scan_file.empty() || !ism_file.empty() || !sweep_values.empty() || !tasks_file.empty() || nfold > 0 || !save_model.empty()) {
+            printf("load-model only scores a test file\n");
+            return help();
+        }
+        if (optind >= argc) {
+            printf("Test data file required\n");
+            return help();
+        }
+        if (top_k > 0 && batch_size <= 0 && mem_budget <= 0) {
+            printf("A batch size (-b) or memory budget (--mem-budget) is required with --top-k\n");
+            return help();
+        }
+        FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+        fastsk->set_mem_budget(mem_budget * (1 << 20));
+        fastsk->set_binary_predictions(pred_binary, true);
+        try {
+            fastsk->load_model(load_model);
+        } catch (const std::exception &e) {
+            printf("Error: %s\n", e.what());
+            return 1;
+        }
+        if (top_k > 0) {
+            fastsk->set_top_k(top_k, top_k_out, fastsk->get_dictionary());
+        }
+        FastaSource source(argv[optind], fastsk->get_dictionary());
+        fastsk->score_stream(source, (batch_size <= 0 && mem_budget <= 0) ? INT_MAX : batch_size);
+        return 0;
+    }
+
+    if (!load_kernel.empty() || !save_kernel.empty()) {
+        if (batch_size > 0 || mem_budget > 0 || kmer_length > 0 || !scan_file.empty() || !ism_file.empty() || nfold > 0) {
+            printf("save-kernel and load-kernel only run on the one-shot kernel of a training and a test file\n");
+            return help();
+        }
+        if (!load_kernel.empty() && !save_model.empty()) {
+            printf("save-model needs the training sequences, which a loaded kernel does not have\n");
+            return help();
         }
     }
 
-    if (g == -1) {
+    // a loaded kernel has the kernel parameters and the labels of the sequences
+    if (g == -1 && load_kernel.empty()) {
         printf("Must provide a value for the g parameter\n");
         return help();
     }
-    if (m == -1) {
+    if (m == -1 && load_kernel.empty()) {
         printf("Must provide a value for the m parameter\n");
         return help();
     }
@@ -102,45 +369,167 @@ int main(int argc, char* argv[]) {
 
     int arg_num = optind;
 
-    if (arg_num < argc) {
+    if (!load_kernel.empty()) {
+        // no sequence files
+    } else if (arg_num < argc) {
         train_file = argv[arg_num++];
     } else {
         printf("Train data file required\n");
         return help();
     }
-    if (arg_num < argc) {
+    if (kmer_length > 0) {
+        if (batch_size <= 0 && mem_budget <= 0) {
+            printf("A batch size (-b) or memory budget (--mem-budget) is required with --kmers\n");
+            return help();
+        }
+    } else if (!scan_file.empty() || nfold > 0 || !load_kernel.empty()) {
+        // the scanned sequences take the place of the test file, and cross validation has none
+    } else if (arg_num < argc) {
         test_file = argv[arg_num++];
     } else {
         printf("Test data file required\n");
         return help();
     }
-    if (arg_num < argc) {
+    if (arg_num < argc && load_kernel.empty()) {
         dictionary_file = argv[arg_num++];
     }
+    if (top_k > 0 && batch_size <= 0 && mem_budget <= 0) {
+        printf("A batch size (-b) or memory budget (--mem-budget) is required with --top-k\n");
+        return help();
+    }
+    if (!sweep_values.empty() && (batch_size > 0 || mem_budget > 0 || kmer_length > 0 || !scan_file.empty() || !ism_file.empty())) {
+        printf("sweep-C only runs on the one-shot kernel of a training and a test file\n");
+        return help();
+    }
+    if (!save_model.empty() && (kmer_length > 0 || !scan_file.empty() || !ism_file.empty() || !sweep_values.empty() || !tasks_file.empty() || nfold > 0)) {
+        printf("save-model only saves the model of the one-shot or batch modes\n");
+        return help();
+    }
+    if (nfold > 0 && (batch_size > 0 || mem_budget > 0 || kmer_length > 0 || !scan_file.empty() || !ism_file.empty() || !sweep_values.empty() || !tasks_file.empty())) {
+        printf("cv only runs on the kernel of a training file\n");
+        return help();
+    }
+    if (!tasks_file.empty() && (batch_size > 0 || mem_budget > 0 || kmer_length > 0 || !scan_file.empty() || !ism_file.empty() || !sweep_values.empty())) {
+        printf("tasks only runs on the one-shot kernel of a training and a test file\n");
+        return help();
+    }
+    if (approx && !ism_file.empty()) {
+        printf("ism needs the exact kernel; it cannot be used with -a\n");
+        return help();
+    }
+    if (approx && !scan_file.empty()) {
+        printf("scan needs the exact kernel; it cannot be used with -a\n");
+        return help();
+    }
 
     FastSK* fastsk = new FastSK(g, m, t, approx, delta, max_iters, skip_variance);
+    fastsk->set_mem_budget(mem_budget * (1 << 20));
+    // enumerated k-mers have no labels worth storing
+    fastsk->set_binary_predictions(pred_binary, kmer_length <= 0);
+    fastsk->set_single_precision(float_kernel);
+
+
+    // All k-mers of a fixed length as the test set //
+    if (kmer_length > 0) {
+        DataReader* data_reader = new DataReader(train_file, dictionary_file);
+        data_reader->read_data(train_file, true);
+
+        int alphabet_size = 0;
+        for (auto it = data_reader->dictmap.begin(); it != data_reader->dictmap.end(); it++) {
+            if (it->second > 0) alphabet_size++;
+        }
+        if (kmer_shard != -1) {
+            uint64_t total = KmerSource::count(kmer_length, alphabet_size);
+            KmerSource::shard_range(total, kmer_shard, kmer_num_shards, kmer_start, kmer_end);
+        }
+        KmerSource source(kmer_length, data_reader->dictmap, kmer_start, kmer_end);
+
+        if (top_k > 0) {
+            fastsk->set_top_k(top_k, top_k_out, data_reader->dictmap);
+        }
+        fastsk->batch_score(data_reader->train_seq, data_reader->train_labels.data(), source, batch_size, C, nu, eps, kernel_type);
+    }
+    // Cross validation on the training kernel //
+    else if (nfold > 0) {
+        DataReader* data_reader = new DataReader(train_file, dictionary_file);
+        data_reader->read_data(train_file, true);
 
+        fastsk->compute_train(data_reader->train_seq, data_reader->train_labels.data());
+        vector<FoldResult> results = fastsk->cross_validate(nfold, C, nu, eps, kernel_type);
+        write_folds(results, cv_out);
+    }
+    // Sliding-window scan of long sequences //
+    else if (!scan_file.empty()) {
+        DataReader* data_reader = new DataReader(train_file, dictionary_file);
+        data_reader->read_data(train_file, true);
+
+        fastsk->compute_train(data_reader->train_seq, data_reader->train_labels.data());
+        fastsk->fit(C, nu, eps, kernel_type);
+        fastsk->scan(scan_file, data_reader->dictmap, window, stride, scan_out);
+    }
+    // In-silico saturation mutagenesis //
+    else if (!ism_file.empty()) {
+        DataReader* data_reader = new DataReader(train_file, dictionary_file);
+        bool train = true;
+
+        data_reader->read_data(train_file, train);
+        data_reader->read_data(test_file, !train);
+        int* train_labels = data_reader->train_labels.data();
 
+        fastsk->compute_train(data_reader->train_seq, train_labels);
+        fastsk->fit(C, nu, eps, kernel_type);
+        fastsk->ism(data_reader->test_seq, data_reader->dictmap, ism_file, ism_binary);
+    }
+    // Sweep of the C parameter over one kernel //
+    else if (!sweep_values.empty()) {
+        one_shot_kernel(fastsk, load_kernel, save_kernel, train_file, test_file, dictionary_file);
+        vector<SweepResult> results = fastsk->sweep_C(sweep_values, nu, eps, kernel_type);
+        write_sweep(results, sweep_out);
+    }
+    // One model per label column over one kernel //
+    else if (!tasks_file.empty()) {
+        TaskLabels train_tasks, test_tasks;
+        try {
+            train_tasks = read_task_labels(tasks_file);
+            if (!test_tasks_file.empty()) {
+                test_tasks = read_task_labels(test_tasks_file);
+            }
+        } catch (const std::exception &e) {
+            printf("Error: %s\n", e.what());
+            return 1;
+        }
+        one_shot_kernel(fastsk, load_kernel, save_kernel, train_file, test_file, dictionary_file);
+        fastsk->fit_tasks(train_tasks, C, nu, eps, kernel_type);
+        vector<TaskResult> results = fastsk->score_tasks(test_tasks_file.empty() ? NULL : &test_tasks, "auc_file_");
+        write_tasks(results, tasks_out);
+    }
     // FastSK //
-    if (batch_size <= 0) {
-        fastsk->compute_kernel(train_file, test_file, dictionary_file);
+    else if (batch_size <= 0 && mem_budget <= 0) {
+        one_shot_kernel(fastsk, load_kernel, save_kernel, train_file, test_file, dictionary_file);
         fastsk->fit(C, nu, eps, kernel_type);
         fastsk->score("auc", "auc_file_one_shot.txt");
+        if (!save_model.empty()) {
+            fastsk->save_model(save_model);
+        }
     } 
     // Batch-based Versions //
     else {
         DataReader* data_reader = new DataReader(train_file, dictionary_file);
-        bool train = true;
-
-        data_reader->read_data(train_file, train);
-        data_reader->read_data(test_file, !train);
-        vector<vector<int> > train_seq = data_reader->train_seq;
-        vector<vector<int> > test_seq = data_reader->test_seq;
+        data_reader->read_data(train_file, true);
+        const SequenceSet &train_seq = data_reader->train_seq;
         int* train_labels = data_reader->train_labels.data();
-        int* test_labels = data_reader->test_labels.data();
 
         // FastSK-Batch //
-        fastsk->batch_score(train_seq, test_seq, train_labels, test_labels, batch_size, C, nu, eps, kernel_type);
+        // test sequences are streamed from the file one batch at a time
+        FastaSource source(test_file, data_reader->dictmap);
+        if (top_k > 0) {
+            fastsk->set_top_k(top_k, top_k_out, data_reader->dictmap);
+        }
+        fastsk->set_dictionary(data_reader->dictmap);
+        fastsk->batch_score(train_seq, train_labels, source, batch_size, C, nu, eps, kernel_type);
+        if (!save_model.empty()) {
+            fastsk->save_model(save_model);
+        }
 
         // FastSK-Batch-Naive //
         // fastsk->compute_train(train_seq, train_labels);
@@ -148,10 +537,10 @@ int main(int argc, char* argv[]) {
 
         // int i = 0;
         // while (i < (int) test_seq.size()) {
-        //     vector<vector<int> > test_batch;
+        //     SequenceSet test_batch;
 
         //     for (int j = 0; j < min((int) test_seq.size() - i, batch_size); j++) {
-        //         test_batch.push_back(test_seq[i + j]);
+        //         test_batch.push_back(test_seq, i + j);
         //     }
         //     fastsk->compute_kernel(train_seq, test_batch, train_labels, test_labels + i);
         //     fastsk->score("auc", "auc.txt");
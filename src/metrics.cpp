@@ -0,0 +1,83 @@
+#include "metrics.hpp"
+#include "shared.h"
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+using namespace std;
+
+// Record one prediction: the true label, the predicted label and the score of label 1
+void MetricsAccumulator::add(int label, double guess, double score) {
+    if (label > 0) {
+        this->pos.push_back(score);
+        if (guess < 0) {
+            this->fn++;
+        } else {
+            this->tp++;
+        }
+    } else {
+        this->neg.push_back(score);
+        if (guess > 0) {
+            this->fp++;
+        } else {
+            this->tn++;
+        }
+    }
+
+    if ((guess < 0.0 && label < 0) || (guess > 0.0 && label > 0)) {
+        this->correct++;
+    }
+}
+
+double MetricsAccumulator::auroc() const {
+    return calculate_auc(this->pos.data(), this->neg.data(), this->pos.size(), this->neg.size());
+}
+
+/* Area under the precision-recall curve, as average precision: the precision at
+each distinct score threshold, weighted by the recall gained there. Sequences
+with tied scores enter together. */
+double MetricsAccumulator::auprc() const {
+    long int npos = this->pos.size();
+    vector<pair<double, int> > scored;
+    scored.reserve(this->pos.size() + this->neg.size());
+    for (double s : this->pos) scored.push_back(make_pair(s, 1));
+    for (double s : this->neg) scored.push_back(make_pair(s, 0));
+    sort(scored.begin(), scored.end(),
+        [](const pair<double, int> &a, const pair<double, int> &b) { return a.first > b.first; });
+
+    double ap = 0;
+    long int tp = 0;
+    size_t i = 0;
+    while (i < scored.size()) {
+        size_t j = i;
+        long int new_tp = 0;
+        while (j < scored.size() && scored[j].first == scored[i].first) {
+            new_tp += scored[j].second;
+            j++;
+        }
+        tp += new_tp;
+        ap += new_tp * (tp / (double) j);
+        i = j;
+    }
+    return ap / npos;
+}
+
+double MetricsAccumulator::accuracy() const {
+    return 100 * this->correct / (double) (this->pos.size() + this->neg.size());
+}
+
+void MetricsAccumulator::print(bool quiet) const {
+    long int pagg = this->pos.size();
+    long int nagg = this->neg.size();
+    if (!quiet) {
+        printf("Num sequences: %ld\n", nagg + pagg);
+        printf("Num positive: %ld, Num negative: %ld\n", pagg, nagg);
+        printf("TPR: %f\n", this->tp / (double) pagg);
+        printf("TNR: %f\n", this->tn / (double) nagg);
+        printf("FNR: %f\n", this->fn / (double) pagg);
+        printf("FPR: %f\n", this->fp / (double) nagg);
+    }
+    printf("\nAccuracy: %f\n", this->accuracy());
+    printf("AUROC: %f\n", this->auroc());
+    printf("AUPRC: %f\n", this->auprc());
+}
@@ -0,0 +1,31 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <vector>
+
+using namespace std;
+
+/* Classification metrics accumulated one prediction at a time, so that a test set
+scored in many batches is evaluated as a whole. The score of every prediction
+(the probability of label 1) is kept so that AUROC and AUPRC can be computed by
+sorting once all predictions are in. */
+class MetricsAccumulator {
+    vector<double> pos;             // scores of the positive sequences
+    vector<double> neg;             // scores of the negative sequences
+    long int tp = 0;
+    long int tn = 0;
+    long int fp = 0;
+    long int fn = 0;
+    long int correct = 0;
+
+public:
+    void add(int, double, double);
+    long int num_pos() const { return pos.size(); }
+    long int num_neg() const { return neg.size(); }
+    double auroc() const;
+    double auprc() const;
+    double accuracy() const;
+    void print(bool) const;
+};
+
+#endif
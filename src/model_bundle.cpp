@@ -0,0 +1,151 @@
+#include "model_bundle.hpp"
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char model_magic[8] = {'F', 'S', 'K', 'M', 'D', 'L', '0', '1'};
+
+/* Write a model bundle for the binary model dense, whose training sequences are
+seqs. header holds the kernel settings (g, m, approx, max_iters, skip_variance and
+delta); the rest of it is filled in here. */
+void write_model_bundle(const string path, ModelHeader header, const map<char, int> &dictmap, const SequenceSet &seqs, const DenseModel &dense) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        printf("Error: could not open model file %s\n", path.c_str());
+        exit(1);
+    }
+    memcpy(header.magic, model_magic, sizeof(header.magic));
+    header.kernel_type = dense.kernel_type;
+    header.label[0] = dense.label[0];
+    header.label[1] = dense.label[1];
+    header.probability = dense.probability;
+    header.n_dict = dictmap.size();
+    header.n_seq = seqs.size();
+    header.n_sv = dense.coef.size();
+    header.n_symbols = seqs.symbols.size();
+    header.gamma = dense.gamma;
+    header.rho = dense.rho;
+    header.probA = dense.probA;
+    header.probB = dense.probB;
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        int32_t entry[2] = {(uint8_t) it->first, it->second};
+        fwrite(entry, sizeof(int32_t), 2, file);
+    }
+    vector<int64_t> offsets(seqs.offsets.begin(), seqs.offsets.end());
+    fwrite(offsets.data(), sizeof(int64_t), offsets.size(), file);
+    fwrite(dense.w.data(), sizeof(double), dense.w.size(), file);
+    fwrite(dense.coef.data(), sizeof(double), dense.coef.size(), file);
+    fwrite(dense.sv_rows.data(), sizeof(double), dense.sv_rows.size(), file);
+    fwrite(seqs.symbols.data(), sizeof(uint8_t), seqs.symbols.size(), file);
+
+    if (ferror(file) || fclose(file) != 0) {
+        printf("Error: could not write model file %s\n", path.c_str());
+        exit(1);
+    }
+    printf("Wrote the model (%ld support sequences) to %s\n", (long) header.n_seq, path.c_str());
+}
+
+ModelBundle::ModelBundle(const string path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Could not open model file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ModelHeader)) {
+        ::close(fd);
+        throw runtime_error(path + " is not a model file");
+    }
+    this->map_size = st.st_size;
+    this->map = mmap(NULL, this->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (this->map == MAP_FAILED) {
+        throw runtime_error("Could not map model file " + path);
+    }
+
+    // the counts, and the size of sv_rows, are bounded before the expected size is
+    // computed from them, so that it cannot overflow
+    const ModelHeader *header = (const ModelHeader *) this->map;
+    const int64_t max_count = (int64_t) 1 << 31;
+    bool valid = memcmp(header->magic, model_magic, sizeof(model_magic)) == 0
+        && header->n_dict >= 0 && header->n_dict <= 256
+        && header->n_seq >= 0 && header->n_seq < max_count
+        && header->n_sv >= 0 && header->n_sv <= header->n_seq
+        && header->n_sv * (header->n_seq + 1) < ((int64_t) 1 << 40)
+        && header->n_symbols >= 0 && header->n_symbols < ((int64_t) 1 << 48)
+        && (header->kernel_type == FASTSK || header->kernel_type == LINEAR || header->kernel_type == RBF)
+        && (header->kernel_type == RBF || header->n_sv == 0);
+    size_t expected = !valid ? 0 : sizeof(ModelHeader) + 2 * sizeof(int32_t) * header->n_dict
+        + sizeof(int64_t) * (header->n_seq + 1) + sizeof(double) * header->n_seq
+        + sizeof(double) * header->n_sv * (header->n_seq + 1) + header->n_symbols;
+    if (!valid || this->map_size < expected) {
+        munmap(this->map, this->map_size);
+        throw runtime_error(path + " is not a model file");
+    }
+
+    this->header = header;
+    this->dict = (const int32_t *) (header + 1);
+    this->offsets = (const int64_t *) (this->dict + 2 * header->n_dict);
+    this->w = (const double *) (this->offsets + header->n_seq + 1);
+    this->coef = this->w + header->n_seq;
+    this->sv_rows = this->coef + header->n_sv;
+    this->symbols = (const uint8_t *) (this->sv_rows + header->n_sv * header->n_seq);
+
+    for (int64_t i = 0; i < header->n_seq; i++) {
+        if (this->offsets[i] < 0 || this->offsets[i] > this->offsets[i + 1]) {
+            valid = false;
+        }
+    }
+    if (!valid || this->offsets[0] != 0 || this->offsets[header->n_seq] != header->n_symbols) {
+        munmap(this->map, this->map_size);
+        throw runtime_error(path + " has corrupt sequence offsets");
+    }
+}
+
+ModelBundle::~ModelBundle() {
+    munmap(this->map, this->map_size);
+}
+
+std::map<char, int> ModelBundle::dictmap() const {
+    std::map<char, int> dictmap;
+    for (int i = 0; i < this->header->n_dict; i++) {
+        dictmap[(char) this->dict[2 * i]] = this->dict[2 * i + 1];
+    }
+    return dictmap;
+}
+
+SequenceSet ModelBundle::sequences() const {
+    SequenceSet seqs;
+    seqs.symbols.assign(this->symbols, this->symbols + this->header->n_symbols);
+    seqs.offsets.assign(this->offsets, this->offsets + this->header->n_seq + 1);
+    return seqs;
+}
+
+DenseModel ModelBundle::dense_model() const {
+    const ModelHeader *header = this->header;
+    DenseModel dense;
+    dense.kernel_type = header->kernel_type;
+    dense.n_train = header->n_seq;
+    dense.w.assign(this->w, this->w + header->n_seq);
+    dense.coef.assign(this->coef, this->coef + header->n_sv);
+    dense.sv_rows.assign(this->sv_rows, this->sv_rows + header->n_sv * header->n_seq);
+    dense.gamma = header->gamma;
+    dense.rho = header->rho;
+    dense.label[0] = header->label[0];
+    dense.label[1] = header->label[1];
+    dense.probability = header->probability != 0;
+    dense.probA = header->probA;
+    dense.probB = header->probB;
+    dense.available = true;
+    return dense;
+}
@@ -0,0 +1,80 @@
+#ifndef MODEL_BUNDLE_H
+#define MODEL_BUNDLE_H
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include "shared.h"
+#include "dense_model.hpp"
+
+using namespace std;
+
+/* Binary model bundle layout, in native byte order:
+    char    magic[8]        "FSKMDL01"
+    int32   g, m            g-mer length and mismatches of the kernel
+    int32   approx          kernel approximation settings given to FastSK
+    int32   max_iters
+    int32   skip_variance
+    int32   kernel_type     LINEAR, RBF or FASTSK, as in svm.h
+    int32   label[2]        labels of the model, decision values are positive for label[0]
+    int32   probability     1 if probA and probB hold a Platt sigmoid
+    int32   n_dict          number of dictionary entries
+    int64   n_seq           number of support sequences
+    int64   n_sv            number of support vectors, rbf only
+    int64   n_symbols       total length of the support sequences
+    float64 delta, gamma, rho, probA, probB
+    int32   dict[n_dict][2] character and symbol code of each dictionary entry
+    int64   offsets[n_seq + 1]  start of each support sequence in symbols
+    float64 w[n_seq]        weight of each support sequence (fastsk and linear)
+    float64 coef[n_sv]      coefficient of each support vector (rbf)
+    float64 sv_rows[n_sv][n_seq]    kernel row of each support vector (rbf)
+    uint8   symbols[n_symbols]
+Every array starts at a multiple of 8 bytes, so a mapped file can be read in place.
+The support sequences are the ones a test sequence's kernel row is needed against:
+the support vectors for the fastsk kernel, and for the linear and rbf kernels, whose
+features are whole kernel rows, the training sequences. */
+typedef struct ModelHeader {
+    char magic[8];
+    int32_t g;
+    int32_t m;
+    int32_t approx;
+    int32_t max_iters;
+    int32_t skip_variance;
+    int32_t kernel_type;
+    int32_t label[2];
+    int32_t probability;
+    int32_t n_dict;
+    int64_t n_seq;
+    int64_t n_sv;
+    int64_t n_symbols;
+    double delta;
+    double gamma;
+    double rho;
+    double probA;
+    double probB;
+} ModelHeader;
+
+void write_model_bundle(const string, ModelHeader, const map<char, int> &, const SequenceSet &, const DenseModel &);
+
+// Read-only memory mapping of a model bundle
+class ModelBundle {
+    void *map;
+    size_t map_size;
+    const int32_t *dict;
+    const int64_t *offsets;
+    const double *w;
+    const double *coef;
+    const double *sv_rows;
+    const uint8_t *symbols;
+
+public:
+    const ModelHeader *header;
+
+    ModelBundle(const string);
+    ~ModelBundle();
+    std::map<char, int> dictmap() const;
+    SequenceSet sequences() const;
+    DenseModel dense_model() const;
+};
+
+#endif
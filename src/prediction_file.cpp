@@ -0,0 +1,124 @@
+#include "prediction_file.hpp"
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char prediction_magic[8] = {'F', 'S', 'K', 'P', 'R', 'D', '0', '1'};
+
+PredictionWriter::PredictionWriter(const string path, bool binary, bool with_labels) {
+    this->binary = binary;
+    this->with_labels = with_labels;
+    this->n = 0;
+    this->file = fopen(path.c_str(), binary ? "wb" : "w+");
+    if (this->file == NULL) {
+        printf("Error: could not open predictions file %s\n", path.c_str());
+        exit(1);
+    }
+    if (binary) {
+        // the count is filled in by close
+        PredictionHeader header;
+        memset(&header, 0, sizeof(header));
+        fwrite(&header, sizeof(header), 1, this->file);
+    }
+}
+
+PredictionWriter::~PredictionWriter() {
+    this->close();
+}
+
+void PredictionWriter::write(int label, double prob) {
+    this->n++;
+    if (!this->binary) {
+        fprintf(this->file, "%d,%f\n", label, prob);
+        return;
+    }
+    float score = prob;
+    fwrite(&score, sizeof(float), 1, this->file);
+    if (this->with_labels) {
+        if (label < INT8_MIN || label > INT8_MAX) {
+            printf("Error: label %d does not fit in a binary predictions file\n", label);
+            exit(1);
+        }
+        this->labels.push_back(label);
+    }
+}
+
+void PredictionWriter::close() {
+    if (this->file == NULL) {
+        return;
+    }
+    if (this->binary) {
+        if (this->with_labels) {
+            fwrite(this->labels.data(), sizeof(int8_t), this->labels.size(), this->file);
+        }
+        PredictionHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, prediction_magic, sizeof(header.magic));
+        header.has_labels = this->with_labels;
+        header.n = this->n;
+        fseek(this->file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, this->file);
+    }
+    fclose(this->file);
+    this->file = NULL;
+}
+
+PredictionFile::PredictionFile(const string path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Could not open predictions file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(PredictionHeader)) {
+        ::close(fd);
+        throw runtime_error(path + " is not a binary predictions file");
+    }
+    this->map_size = st.st_size;
+    this->map = mmap(NULL, this->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (this->map == MAP_FAILED) {
+        throw runtime_error("Could not map predictions file " + path);
+    }
+
+    const PredictionHeader *header = (const PredictionHeader *) this->map;
+    // n is bounded by the size of the file before it is used, so that a corrupt count cannot overflow
+    size_t row_bytes = sizeof(float) + (header->has_labels ? sizeof(int8_t) : 0);
+    if (memcmp(header->magic, prediction_magic, sizeof(prediction_magic)) != 0 || header->n < 0
+        || (uint64_t) header->n > (this->map_size - sizeof(PredictionHeader)) / row_bytes) {
+        munmap(this->map, this->map_size);
+        throw runtime_error(path + " is not a binary predictions file");
+    }
+    this->n = header->n;
+    this->scores = (const float *) ((const char *) this->map + sizeof(PredictionHeader));
+    this->labels = header->has_labels ? (const int8_t *) (this->scores + this->n) : NULL;
+}
+
+PredictionFile::~PredictionFile() {
+    munmap(this->map, this->map_size);
+}
+
+/* Rewrite a binary predictions file as the CSV written by default. Scores were
+stored as float32, so the last printed digit can differ from a direct CSV run. A
+file without labels becomes one probability per line. */
+void convert_predictions(const string infile, const string outfile) {
+    PredictionFile predictions(infile);
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        throw runtime_error("Could not open " + outfile);
+    }
+    for (int64_t i = 0; i < predictions.n; i++) {
+        if (predictions.labels != NULL) {
+            fprintf(out, "%d,%f\n", predictions.labels[i], predictions.scores[i]);
+        } else {
+            fprintf(out, "%f\n", predictions.scores[i]);
+        }
+    }
+    fclose(out);
+}
@@ -0,0 +1,57 @@
+#ifndef PREDICTION_FILE_H
+#define PREDICTION_FILE_H
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+
+using namespace std;
+
+/* Binary predictions file layout, in native byte order:
+    char    magic[8]        "FSKPRD01"
+    int32   has_labels      1 if the label array is present
+    int32   reserved
+    int64   n               number of predictions
+    float32 scores[n]       probability of the model's first label, as in the CSV
+    int8    labels[n]       true labels, only if has_labels
+The scores start at byte 24, so a mapped file can be read in place. */
+typedef struct PredictionHeader {
+    char magic[8];
+    int32_t has_labels;
+    int32_t reserved;
+    int64_t n;
+} PredictionHeader;
+
+// Writes predictions one at a time, either as "label,probability" CSV lines or in the binary layout
+class PredictionWriter {
+    FILE *file;
+    bool binary;
+    bool with_labels;
+    int64_t n;
+    vector<int8_t> labels;          // binary labels are buffered until close, as they follow all scores
+
+public:
+    PredictionWriter(const string, bool, bool);
+    ~PredictionWriter();
+    void write(int, double);
+    void close();
+};
+
+// Read-only memory mapping of a binary predictions file
+class PredictionFile {
+    void *map;
+    size_t map_size;
+
+public:
+    int64_t n;
+    const float *scores;
+    const int8_t *labels;           // NULL when the file has no labels
+
+    PredictionFile(const string);
+    ~PredictionFile();
+};
+
+void convert_predictions(const string, const string);
+
+#endif
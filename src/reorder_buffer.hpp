@@ -0,0 +1,34 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <map>
+#include <mutex>
+#include <functional>
+
+/* Restores input order for work completed out of order by several threads.
+Items are tagged with their sequence number; the sink is called exactly once per
+item, in increasing sequence number order, from whichever thread completes the
+gap. Items that arrive early are held until all earlier ones have been sunk. */
+template <typename T>
+class ReorderBuffer {
+    std::map<size_t, T> pending;
+    size_t next;
+    std::function<void(T &)> sink;
+    std::mutex lock;
+
+public:
+    ReorderBuffer(std::function<void(T &)> sink) : next(0), sink(sink) {}
+
+    void put(size_t seq, T item) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->pending.insert(std::make_pair(seq, std::move(item)));
+        auto it = this->pending.begin();
+        while (it != this->pending.end() && it->first == this->next) {
+            this->sink(it->second);
+            it = this->pending.erase(it);
+            this->next++;
+        }
+    }
+};
+
+#endif
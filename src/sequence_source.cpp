@@ -0,0 +1,165 @@
+#include "sequence_source.hpp"
+#include "utils.hpp"
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include <stdio.h>
+
+using namespace std;
+
+VectorSource::VectorSource(const SequenceSet &seqs, const int *labels) : seqs(seqs) {
+    this->labels = labels;
+    this->next = 0;
+}
+
+int VectorSource::next_batch(SequenceSet &seqs, vector<int> &labels, int max_seqs) {
+    size_t end = min(this->seqs.size(), this->next + max_seqs);
+    seqs.clear();
+    for (size_t i = this->next; i < end; i++) {
+        seqs.push_back(this->seqs, i);
+    }
+    labels.assign(this->labels + this->next, this->labels + end);
+    int n = end - this->next;
+    this->next = end;
+    return n;
+}
+
+FastaSource::FastaSource(const string data_file, const map<char, int> &dictmap) {
+    this->dictmap = dictmap;
+    this->num_read = 0;
+    this->file.open(data_file);
+    if (this->file.fail()) {
+        ostringstream msg;
+        msg << "Data file \"" << data_file << "\" could not be opened." << endl;
+        throw runtime_error(msg.str());
+    }
+}
+
+int FastaSource::next_batch(SequenceSet &seqs, vector<int> &labels, int max_seqs) {
+    seqs.clear();
+    labels.clear();
+    int n = 0;
+    int label;
+    // max_seqs can be INT_MAX for a single batch, so labels grow as records are read
+    while (n < max_seqs && read_labeled_record(this->file, this->dictmap, seqs, label)) {
+        labels.push_back(label);
+        n++;
+    }
+    this->num_read += n;
+    if (n == 0) {
+        cout << "Read " << this->num_read << " test sequences" << endl;
+    }
+    return n;
+}
+
+KmerSource::KmerSource(int length, const map<char, int> &dictmap, uint64_t start, uint64_t end) {
+    // std::map iterates characters in sorted order, which defines the enumeration order
+    for (auto it = dictmap.begin(); it != dictmap.end(); it++) {
+        if (it->second > 0) {
+            this->symbols.push_back(it->second);
+        }
+    }
+    if (this->symbols.empty()) {
+        throw runtime_error("Cannot enumerate k-mers over an empty dictionary");
+    }
+
+    uint64_t total = KmerSource::count(length, this->symbols.size());
+    if (end > total) end = total;
+    if (start > end) start = end;
+
+    this->length = length;
+    this->next = start;
+    this->end = end;
+
+    // digits of the first sequence, most significant first
+    this->digits.assign(length, 0);
+    uint64_t rem = start;
+    for (int j = length - 1; j >= 0; j--) {
+        this->digits[j] = rem % this->symbols.size();
+        rem /= this->symbols.size();
+    }
+}
+
+// Number of sequences of the given length over an alphabet of the given size
+uint64_t KmerSource::count(int length, int alphabet_size) {
+    uint64_t total = 1;
+    for (int j = 0; j < length; j++) {
+        if (total > UINT64_MAX / alphabet_size) {
+            throw runtime_error("Number of k-mers does not fit in 64 bits");
+        }
+        total *= alphabet_size;
+    }
+    return total;
+}
+
+// Range [start, end) of shard `shard` out of `num_shards` equal shards of [0, total)
+void KmerSource::shard_range(uint64_t total, int shard, int num_shards, uint64_t &start, uint64_t &end) {
+    if (num_shards < 1 || shard < 0 || shard >= num_shards) {
+        throw runtime_error("Shard index must be in [0, number of shards)");
+    }
+    start = total / num_shards * shard + min((uint64_t) shard, total % num_shards);
+    end = total / num_shards * (shard + 1) + min((uint64_t) shard + 1, total % num_shards);
+}
+
+int KmerSource::next_batch(SequenceSet &seqs, vector<int> &labels, int max_seqs) {
+    uint64_t n = min((uint64_t) max_seqs, this->end - this->next);
+    int length = this->length;
+    int base = this->symbols.size();
+
+    seqs.clear();
+    seqs.symbols.reserve(n * length);
+    labels.assign(n, -1);
+    for (uint64_t i = 0; i < n; i++) {
+        uint8_t *seq = seqs.extend(length);
+        for (int j = 0; j < length; j++) {
+            seq[j] = this->symbols[this->digits[j]];
+        }
+
+        // advance the odometer
+        for (int j = length - 1; j >= 0; j--) {
+            if (++this->digits[j] < base) break;
+            this->digits[j] = 0;
+        }
+    }
+    this->next += n;
+
+    return n;
+}
+
+BudgetSource::BudgetSource(SequenceSource &source, std::function<double(int)> cost, double budget) : source(source) {
+    this->cost = cost;
+    this->budget = budget;
+    this->last_size = 0;
+}
+
+int BudgetSource::next_batch(SequenceSet &seqs, vector<int> &labels, int max_seqs) {
+    seqs.clear();
+    labels.clear();
+    double used = 0;
+    bool full = false;
+    while ((int) seqs.size() < max_seqs) {
+        if (this->pending.empty() && this->source.next_batch(this->pending, this->pending_labels, 1) == 0) {
+            break;
+        }
+        double bytes = this->cost(this->pending.length(0));
+        if (!seqs.empty() && used + bytes > this->budget) {
+            full = true;
+            break;
+        }
+        used += bytes;
+        seqs.push_back(this->pending, 0);
+        labels.push_back(this->pending_labels[0]);
+        this->pending.clear();
+        this->pending_labels.clear();
+    }
+
+    int n = seqs.size();
+    if (full && n != this->last_size) {
+        printf("Memory budget allows a batch of %d sequences (%.1f MB estimated)\n", n, used / (1 << 20));
+        this->last_size = n;
+    }
+    return n;
+}
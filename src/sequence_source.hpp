@@ -0,0 +1,83 @@
+#ifndef SEQUENCE_SOURCE_H
+#define SEQUENCE_SOURCE_H
+
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <fstream>
+#include <functional>
+#include "shared.h"
+
+using namespace std;
+
+/* A producer of labeled test sequences for FastSK::batch_score. Sources hand
+out consecutive batches so that the full test set never has to be held in
+memory at once. */
+class SequenceSource {
+public:
+    virtual ~SequenceSource() {}
+    // Replace the contents of seqs and labels with up to max_seqs sequences.
+    // Returns the number of sequences produced; 0 once the source is exhausted.
+    virtual int next_batch(SequenceSet &seqs, vector<int> &labels, int max_seqs) = 0;
+};
+
+// Sequences that are already in memory, e.g. read by DataReader
+class VectorSource : public SequenceSource {
+    const SequenceSet &seqs;
+    const int *labels;
+    size_t next;
+
+public:
+    VectorSource(const SequenceSet &, const int *);
+    int next_batch(SequenceSet &, vector<int> &, int);
+};
+
+// Streams a labeled FASTA file, reading only as many records as requested
+class FastaSource : public SequenceSource {
+    ifstream file;
+    map<char, int> dictmap;
+    int num_read;
+
+public:
+    FastaSource(const string, const map<char, int> &);
+    int next_batch(SequenceSet &, vector<int> &, int);
+};
+
+/* Enumerates every sequence of a fixed length over an alphabet, in lexicographic
+order of the alphabet characters, without materializing them in a file. Sequence
+number i is the base-|alphabet| representation of i, so any half-open range
+[start, end) of the enumeration can be scored independently, e.g. one shard
+per process. Every sequence is labeled -1. */
+class KmerSource : public SequenceSource {
+    int length;
+    vector<int> symbols;            // dictionary codes ordered by character
+    uint64_t next;
+    uint64_t end;
+    vector<int> digits;             // base-|alphabet| digits of next
+
+public:
+    KmerSource(int, const map<char, int> &, uint64_t, uint64_t);
+    static uint64_t count(int, int);
+    static void shard_range(uint64_t, int, int, uint64_t &, uint64_t &);
+    int next_batch(SequenceSet &, vector<int> &, int);
+};
+
+/* Cuts the stream of another source into batches whose estimated memory, the sum
+of cost(length) over the batch, stays within a budget. Sequences are pulled one at
+a time, so the batch size follows the sequence lengths as they change along the
+stream. A single sequence over budget still forms a batch on its own. */
+class BudgetSource : public SequenceSource {
+    SequenceSource &source;
+    std::function<double(int)> cost;
+    double budget;
+    SequenceSet pending;            // sequence read ahead that did not fit the last batch
+    vector<int> pending_labels;
+    int last_size;
+
+public:
+    BudgetSource(SequenceSource &, std::function<double(int)>, double);
+    int next_batch(SequenceSet &, vector<int> &, int);
+};
+
+#endif
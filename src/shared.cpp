@@ -9,6 +9,7 @@
 #include <iostream>
 #include <random>
 #include <vector>
+#include <algorithm>
 
 #define STRMAXLEN 15000
 #define MAXNSTR 15000
@@ -52,11 +53,11 @@ Features* extractFeatures(int **S, int *seqLengths, int nStr, int g) {
     return F;
 }
 
-Features* extractFeatures(int **S, std::vector<int> seqLengths, int nStr, int g) {
+Features* extractFeatures(const uint8_t **S, std::vector<int> seqLengths, int nStr, int g) {
     int i, j, j1;
     int *group;
     int *features;
-    int *s;
+    const uint8_t *s;
     int c;
     Features *F;
     int nfeat = 0;
@@ -437,16 +438,14 @@ void g_greater_than_shortest_test(int g, int len) {
     exit(1);
 }
 
-double calculate_auc(double* pos, double* neg, int npos, int nneg) {
-    int correct = 0;
-    int total = 0;
-    for (int i = 0; i < npos; i++){
-        for (int j = 0; j < nneg; j++){
-            if (pos[i] > neg[j]){
-                correct++;
-            }   
-            total++;
-        }
+// Fraction of (positive, negative) pairs where the positive scores strictly higher.
+// Sorts a copy of the negative scores, so it runs in O((npos + nneg) log nneg).
+double calculate_auc(const double* pos, const double* neg, long int npos, long int nneg) {
+    std::vector<double> sorted_neg(neg, neg + nneg);
+    std::sort(sorted_neg.begin(), sorted_neg.end());
+    double correct = 0;
+    for (long int i = 0; i < npos; i++) {
+        correct += std::lower_bound(sorted_neg.begin(), sorted_neg.end(), pos[i]) - sorted_neg.begin();
     }
-    return (double)correct / total;
+    return correct / ((double) npos * nneg);
 }
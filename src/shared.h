@@ -8,6 +8,48 @@
 #include <stdlib.h>
 #include <cstdlib>
 #include <vector>
+#include <stdint.h>
+
+/* Sequences stored back to back in one buffer of symbol codes, one byte per
+symbol. Sequence i is symbols[offsets[i]] to symbols[offsets[i + 1] - 1]. Sets are
+passed by const reference; copies are only made where a set must outlive its
+caller, such as the training sequences kept by FastSK. */
+class SequenceSet {
+public:
+    std::vector<uint8_t> symbols;
+    std::vector<long int> offsets;
+
+    SequenceSet() : offsets(1, 0) {}
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return offsets.size() == 1; }
+    int length(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    const uint8_t *data(size_t i) const { return symbols.data() + offsets[i]; }
+    uint8_t *data(size_t i) { return symbols.data() + offsets[i]; }
+
+    void push_back(const uint8_t *seq, int len) {
+        symbols.insert(symbols.end(), seq, seq + len);
+        offsets.push_back(symbols.size());
+    }
+    // Append sequence i of another set
+    void push_back(const SequenceSet &other, size_t i) {
+        push_back(other.data(i), other.length(i));
+    }
+    // Start a sequence of len symbols at the end of the set and return its symbols
+    uint8_t *extend(int len) {
+        symbols.resize(symbols.size() + len);
+        offsets.push_back(symbols.size());
+        return symbols.data() + offsets[offsets.size() - 2];
+    }
+    void clear() {
+        symbols.clear();
+        offsets.assign(1, 0);
+    }
+    void swap(SequenceSet &other) {
+        symbols.swap(other.symbols);
+        offsets.swap(other.offsets);
+    }
+};
 
 typedef struct Feature {
 	int *features;
@@ -19,17 +61,22 @@ typedef struct Feature {
 	}
 } Features;
 
+/* test_features holds the distinct g-mers of the test batch; the test rows that
+g-mer i occurs in (once per occurrence) are test_groups[test_group_start[i]]
+to test_groups[test_group_start[i + 1] - 1]. */
 typedef struct BatchFeature {
     std::string *test_features;
     std::string *train_features;
     int *test_groups;
+    int *test_group_start;
     int *train_groups;
     int n_train_feat;
     int n_test_feat;
     ~BatchFeature() {
-        delete test_features;
-        delete train_features;
+        delete[] test_features;
+        delete[] train_features;
         free(test_groups);
+        free(test_group_start);
         free(train_groups);
     }
 } BatchFeature;
@@ -51,7 +98,7 @@ typedef struct WorkItem {
 	int combo_num;
 } WorkItem;
 
-Features* extractFeatures(int **S, std::vector<int> seqLengths, int nStr, int g);
+Features* extractFeatures(const uint8_t **S, std::vector<int> seqLengths, int nStr, int g);
 Features* extractFeatures(int **S, int* seqLengths, int nStr, int g);
 double& tri_access(double* array, int i, int j);
 unsigned int& tri_access(unsigned int* array, int i, int j, int N);
@@ -70,6 +117,6 @@ void validate_args(int g, int m);
 void g_greater_than_shortest_err(int g, int len, std::string filename);
 void g_greater_than_shortest_train(int g, int len);
 void g_greater_than_shortest_test(int g, int len);
-double calculate_auc(double* pos, double* neg, int npos, int nneg);
+double calculate_auc(const double* pos, const double* neg, long int npos, long int nneg);
 
 #endif
@@ -0,0 +1,104 @@
+#include "top_scores.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+BoundedHeap::BoundedHeap(size_t capacity, bool lowest) {
+    this->capacity = capacity;
+    this->lowest = lowest;
+}
+
+// Whether (score, index) ranks ahead of item
+bool BoundedHeap::better(double score, long index, const ScoredSequence &item) const {
+    if (score != item.score) {
+        return this->lowest ? score < item.score : score > item.score;
+    }
+    return index < item.index;
+}
+
+bool BoundedHeap::admits(double score, long index) const {
+    if (this->capacity == 0) {
+        return false;
+    }
+    return this->items.size() < this->capacity || this->better(score, index, this->items.front());
+}
+
+void BoundedHeap::push(double score, long index, const uint8_t *seq, int len) {
+    if (!this->admits(score, index)) {
+        return;
+    }
+    auto worse_first = [this](const ScoredSequence &a, const ScoredSequence &b) {
+        return this->better(a.score, a.index, b);
+    };
+    if (this->items.size() == this->capacity) {
+        pop_heap(this->items.begin(), this->items.end(), worse_first);
+        this->items.pop_back();
+    }
+    ScoredSequence item;
+    item.score = score;
+    item.index = index;
+    item.seq.assign(seq, seq + len);
+    this->items.push_back(std::move(item));
+    push_heap(this->items.begin(), this->items.end(), worse_first);
+}
+
+void BoundedHeap::merge(const BoundedHeap &other) {
+    for (const ScoredSequence &item : other.items) {
+        this->push(item.score, item.index, item.seq.data(), item.seq.size());
+    }
+}
+
+// The kept sequences, best first
+vector<ScoredSequence> BoundedHeap::sorted() const {
+    vector<ScoredSequence> items(this->items);
+    sort(items.begin(), items.end(), [this](const ScoredSequence &a, const ScoredSequence &b) {
+        return this->better(a.score, a.index, b);
+    });
+    return items;
+}
+
+TopScores::TopScores(int k, int num_threads) {
+    this->k = k;
+    this->highest.assign(num_threads, BoundedHeap(k, false));
+    this->lowest.assign(num_threads, BoundedHeap(k, true));
+}
+
+// Offer a sequence to the heaps of thread tid
+void TopScores::add(int tid, double score, long index, const uint8_t *seq, int len) {
+    this->highest[tid].push(score, index, seq, len);
+    this->lowest[tid].push(score, index, seq, len);
+}
+
+/* Merge the per-thread heaps and write the k highest and k lowest scoring
+sequences, best first, as tab separated lines of end ("high" or "low"), rank,
+position in the test stream, sequence and decision value. alphabet maps symbol
+codes back to characters. */
+void TopScores::write(const string outfile, const vector<char> &alphabet) {
+    FILE *out = fopen(outfile.c_str(), "w");
+    if (out == NULL) {
+        printf("Error: could not open top-k output file %s\n", outfile.c_str());
+        exit(1);
+    }
+    fprintf(out, "end\trank\tindex\tsequence\tscore\n");
+
+    for (int end = 0; end < 2; end++) {
+        vector<BoundedHeap> &heaps = (end == 0) ? this->highest : this->lowest;
+        BoundedHeap merged(this->k, end == 1);
+        for (const BoundedHeap &heap : heaps) {
+            merged.merge(heap);
+        }
+        vector<ScoredSequence> items = merged.sorted();
+        for (size_t r = 0; r < items.size(); r++) {
+            string seq;
+            for (uint8_t c : items[r].seq) {
+                seq += (c < alphabet.size()) ? alphabet[c] : 'N';
+            }
+            fprintf(out, "%s\t%zu\t%ld\t%s\t%f\n", (end == 0) ? "high" : "low", r + 1, items[r].index, seq.c_str(), items[r].score);
+        }
+    }
+
+    fclose(out);
+    printf("Wrote the %d highest and lowest scoring sequences to %s\n", this->k, outfile.c_str());
+}
@@ -0,0 +1,49 @@
+#ifndef TOP_SCORES_H
+#define TOP_SCORES_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+using namespace std;
+
+// A scored test sequence, identified by its position in the test stream
+typedef struct ScoredSequence {
+    double score;
+    long index;
+    vector<uint8_t> seq;
+} ScoredSequence;
+
+/* Keeps the `capacity` highest (or lowest) scoring sequences seen so far in a
+heap whose front is the worst one kept. Ties are broken by stream position, so
+the kept set does not depend on how sequences were split between heaps. */
+class BoundedHeap {
+    size_t capacity;
+    bool lowest;
+    vector<ScoredSequence> items;
+
+    bool better(double, long, const ScoredSequence &) const;
+
+public:
+    BoundedHeap(size_t, bool);
+    bool admits(double, long) const;
+    void push(double, long, const uint8_t *, int);
+    void merge(const BoundedHeap &);
+    vector<ScoredSequence> sorted() const;
+};
+
+/* Top-k mode of batch scoring: the highest and lowest scoring sequences of the
+whole test stream, kept in one pair of bounded heaps per prediction thread and
+merged when scoring is done. */
+class TopScores {
+public:
+    int k;
+    vector<BoundedHeap> highest;
+    vector<BoundedHeap> lowest;
+
+    TopScores(int, int);
+    void add(int, double, long, const uint8_t *, int);
+    void write(const string, const vector<char> &);
+};
+
+#endif
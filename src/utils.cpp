@@ -109,7 +109,7 @@ DataReader::DataReader(const string train_file, const string dictionary_file) {
 }
 
 void DataReader::read_data(const string data_file, bool train) {
-    vector<vector<int> > sequences;
+    SequenceSet sequences;
     vector<int> labels;
     int num_str = 0;
     int length = 0;
@@ -141,11 +141,10 @@ void DataReader::read_data(const string data_file, bool train) {
                 }
                 length = line.length();
 
-                vector<int> seq;
+                uint8_t *seq = sequences.extend(length);
                 for (int i = 0; i < length; i++) {
-                    seq.push_back(this->dictmap[tolower(line[i])]);
+                    seq[i] = this->dictmap[tolower(line[i])];
                 }
-                sequences.push_back(seq);
                 num_str++;
                 is_label = true;
             }
@@ -155,13 +154,122 @@ void DataReader::read_data(const string data_file, bool train) {
     cout << "Read " << num_str << " sequences from \"" << data_file << "\"" << endl;
 
     if (train) {
-        this->train_seq = sequences;
+        this->train_seq.swap(sequences);
         this->train_labels = labels;
         this->num_train_str = num_str;
     } else {
-        this->test_seq = sequences;
+        this->test_seq.swap(sequences);
         this->test_labels = labels;
         this->num_test_str = num_str;
     }
     this->total_num_str += num_str;
 }
+
+/* Read a label matrix: a tab separated header line of task names, then one line
+per sequence, in the order of its FASTA file, with its label for each task. As in
+FASTA headers, positive labels are 1 and negative labels 0 or -1. */
+TaskLabels read_task_labels(const string labels_file) {
+    ifstream file(labels_file);
+    if (file.fail()) {
+        ostringstream msg;
+        msg << "Labels file \"" << labels_file << "\" could not be opened." << endl;
+        throw runtime_error(msg.str());
+    }
+
+    TaskLabels tasks;
+    string line, field;
+    if (getline(file, line)) {
+        istringstream fields(line);
+        while (getline(fields, field, '\t')) {
+            trim_line(field);
+            tasks.names.push_back(field);
+        }
+    }
+    if (tasks.names.empty()) {
+        throw runtime_error("Labels file \"" + labels_file + "\" has no header line of task names");
+    }
+    tasks.labels.resize(tasks.names.size());
+
+    long line_num = 1;
+    while (getline(file, line)) {
+        line_num++;
+        trim_line(line);
+        if (line.empty()) {
+            continue;
+        }
+        istringstream fields(line);
+        size_t t = 0;
+        while (getline(fields, field, '\t')) {
+            trim_line(field);
+            if (t == tasks.names.size() || (field != "1" && field != "0" && field != "-1")) {
+                ostringstream msg;
+                msg << "Line " << line_num << " of labels file \"" << labels_file << "\" must have a label of 1, 0 or -1 for each of the ";
+                msg << tasks.names.size() << " tasks" << endl;
+                throw runtime_error(msg.str());
+            }
+            tasks.labels[t++].push_back(field == "1" ? 1 : -1);
+        }
+        if (t != tasks.names.size()) {
+            ostringstream msg;
+            msg << "Line " << line_num << " of labels file \"" << labels_file << "\" has " << t << " labels for ";
+            msg << tasks.names.size() << " tasks" << endl;
+            throw runtime_error(msg.str());
+        }
+    }
+    return tasks;
+}
+
+/* Read the next record of a regular, possibly multi-line FASTA file such as a
+genome assembly. The name is the first word after '>'; the sequence is not
+truncated. Returns false once the stream is exhausted. */
+bool read_fasta_record(istream &in, string &name, string &seq) {
+    string line;
+    name.clear();
+    seq.clear();
+
+    // skip to the next header
+    while (in.peek() != '>' && getline(in, line)) {}
+    if (!getline(in, line)) {
+        return false;
+    }
+    string::size_type end = line.find_first_of(" \t\r", 1);
+    name = line.substr(1, end == string::npos ? string::npos : end - 1);
+
+    while (in.peek() != '>' && getline(in, line)) {
+        trim_line(line);
+        seq.append(line);
+    }
+    return true;
+}
+
+/* Read the next (label, sequence) pair of a FASTA file in the format expected by
+DataReader::read_data, translating characters through dictmap, and append the
+sequence to seqs. Used to stream test sets batch by batch. Returns false once the
+stream is exhausted. */
+bool read_labeled_record(istream &in, const map<char, int> &dictmap, SequenceSet &seqs, int &label) {
+    string line;
+    bool is_label = true;
+
+    while (getline(in, line)) {
+        trim_line(line);
+        if (line.empty()) continue;
+        if (is_label) {
+            string::size_type pos = line.find_first_of('>');
+            string label_str = line.substr(pos + 1);
+            if (label_str.length() > 2) labelErrorAndExit(label_str);
+            label = stoi(label_str) == 0 ? -1 : stoi(label_str);
+            is_label = false;
+        } else {
+            if (line.length() > STRMAXLEN) {
+                line = line.substr(0, STRMAXLEN);
+            }
+            uint8_t *seq = seqs.extend(line.length());
+            for (size_t i = 0; i < line.length(); i++) {
+                auto it = dictmap.find(tolower(line[i]));
+                seq[i] = (it == dictmap.end()) ? 0 : it->second;
+            }
+            return true;
+        }
+    }
+    return false;
+}
@@ -5,14 +5,15 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <istream>
 
 using namespace std;
 
 class DataReader {
 public:
     map<char, int> dictmap;
-    vector<vector<int> > train_seq;
-    vector<vector<int> > test_seq;
+    SequenceSet train_seq;
+    SequenceSet test_seq;
     vector<int> train_labels;
     vector<int> test_labels;
     int total_num_str = 0;
@@ -25,6 +26,15 @@ public:
     void read_data(const string, bool);
 };
 
+// One label column per task for the same sequences, e.g. the binding of many TFs
+typedef struct TaskLabels {
+    vector<string> names;
+    vector<vector<int> > labels;    // labels[task][sequence], 1 or -1
+} TaskLabels;
+
+TaskLabels read_task_labels(const string);
+bool read_fasta_record(istream &, string &, string &);
+bool read_labeled_record(istream &, const map<char, int> &, SequenceSet &, int &);
 static void inline trim_line(string &);
 map<char, int> infer_dict(const string);
 map<char, int> read_dict(const string);